@@ -1,3 +1,6 @@
+// off_t de 64 bits também em sistemas de 32 bits (offsets do log de pontuações)
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,6 +8,24 @@
 #include <dirent.h>
 #include "raylib.h"
 #include <sys/stat.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <limits.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Posição em arquivo com 64 bits: long tem 32 bits no Windows
+#if defined(_WIN32)
+#define SeekFile _fseeki64
+#define TellFile _ftelli64
+#else
+#define SeekFile fseeko
+#define TellFile ftello
+#endif
 
 #define BACKGROUND_COLOR BLACK
 #define MENU_COLOR WHITE
@@ -14,22 +35,144 @@
 
 #define SCREENWIDTH 1200
 #define SCREENHEIGHT 900
-#define ROWS 16
-#define COLS 24
+#define TARGET_FPS 60
+#define SIM_TICK_RATE 60
+#define SIM_DT (1.0f / SIM_TICK_RATE)
+#define MAX_TICKS_PER_FRAME 4
+#define UNFOCUSED_FPS 10
+#define MAX_MAP_ROWS 1024
+#define MAX_MAP_COLS 1024
 #define TILE_SIZE 50
 #define HUD_HEIGHT 60
+#define VIEW_WIDTH SCREENWIDTH
+#define VIEW_HEIGHT (SCREENHEIGHT - HUD_HEIGHT)
+#define RENDER_SCALE_COUNT 3
 
 #define SWORD_SCORE 40
 #define LIFE_SCORE 20
 #define MONSTER_SCORE 100
 #define ATTACK_DURATION 10
-#define MAX_DEATH_ANIMATIONS 1000
 #define MONSTER_DEATH_DURATION 10
-#define MAX_MONSTERS 10
+#define ATTACK_REACH 3
+#define ATTACK_GRID (2 * ATTACK_REACH + 1)
+#define FACING_COUNT 4
+
+#define PROJECTILE_CAPACITY 4096
+#define FIXED_SHIFT 8
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define PROJECTILE_LIFETIME 120
+#define MONSTER_SHOT_SPEED (FIXED_ONE / 4)
+#define THROW_SPEED (FIXED_ONE / 2)
+#define RANGED_FIRE_INTERVAL 90
+#define RANGED_RANGE 8
+#define THROWABLE_PICKUP 3
+#define PLAYER_SPEED (FIXED_ONE * 8 / SIM_TICK_RATE)
+#define PLAYER_HALF (FIXED_ONE * 3 / 10)
+#define MONSTER_SPEED (FIXED_ONE / 16)
+#define MONSTER_HALF (FIXED_ONE * 2 / 5)
 #define MONSTER_MOVE_INTERVAL 30
+#define AI_NEAR_ROWS (VIEW_HEIGHT / TILE_SIZE / 2 + 1)   // meia tela em volta do jogador
+#define AI_NEAR_COLS (VIEW_WIDTH / TILE_SIZE / 2 + 1)
+#define AI_FAR_TILES 40            // além disso o monstro fica parado
+#define AI_PATH_MARGIN 4           // o campo de distância vai um pouco além da tela
+#define RANGED_KEEP_DISTANCE 3     // monstros 'R' perseguem só até essa distância
+#define AI_BUDGET_US 1000.0        // orçamento padrão da IA por frame (--ia-us)
+#define AI_THINK_COST_US 2.0       // estimativa inicial do custo de um pensamento
 
 #define MAX_SCORES 5
 #define NAME_LENGTH 20
+#define MAX_SCENES 8
+
+#define MAX_ASSETS 64
+#define ASSET_PATH_LENGTH 128
+#define ASSET_WORKERS 2
+#define ASSET_UPLOAD_BUDGET 0.002
+
+#define MAX_VOICES_PER_SOUND 8
+#define MAX_ACTIVE_VOICES 16
+#define MAX_SOUND_EVENTS 64
+#define SOUND_HEARING_TILES 16.0f
+
+#define MAX_INPUT_EVENTS 32
+#define MAX_PENDING_ACTIONS (MAX_INPUT_EVENTS - 4)   // sobra espaço para as 4 direções seguradas no tick
+#define LATENCY_HISTORY 120
+
+#define REWIND_SECONDS 30
+#define REWIND_TICKS (REWIND_SECONDS * SIM_TICK_RATE)
+#define REWIND_KEYFRAME_INTERVAL 60
+#define REWIND_CAPACITY (REWIND_TICKS + REWIND_KEYFRAME_INTERVAL)
+#define REWIND_POOL_SIZE (1 << 20)
+
+#define AUTOSAVE_INTERVAL 30.0f
+#define AUTOSAVE_TOAST_TIME 2.0f
+#define AUTOSAVE_SLOT 0
+#define MAX_SAVE_SLOTS 99
+#define SLOTS_PER_PAGE 5
+#define SLOT_INDEX_FILE "saves/slots.idx"
+#define SLOT_INDEX_MAGIC "ZSLT"
+#define SLOT_INDEX_VERSION 1
+#define THUMB_WIDTH 32
+#define THUMB_HEIGHT 24
+#define THUMB_CELL 4
+
+#define SAVE_MAGIC "ZSAV"
+#define SAVE_VERSION 1
+#define SAVE_HEADER_SIZE 16
+#define MAP_NAME_LENGTH 32
+
+#define SCORE_LOG_FILE "scores.log"
+#define SCORE_INDEX_FILE "scores.idx"
+#define SCORE_LEGACY_FILE "highscores_kl.bin"
+#define SCORE_INDEX_MAGIC "ZIDX"
+#define SCORE_INDEX_VERSION 1
+#define SCORE_TOP_N 10
+#define SCORE_LEVELS 16
+#define SCORE_COMPACT_INTERVAL 256
+#define SCORE_HISTORY_LENGTH 5
+#define SCORE_READ_BATCH 4096
+#define SCORE_RECORD_SIZE (8 + 8 + 4 + 4 + NAME_LENGTH + 4)
+
+#define MAP_CACHE_SIZE 4
+
+#define PATH_CLUSTER_SIZE 16
+#define PATH_CLUSTER_STRIDE (PATH_CLUSTER_SIZE + 2)   // cluster com uma moldura de parede
+#define PATH_ENTRANCE_SPLIT 6          // entradas a partir desse tamanho ganham duas transições
+#define PATH_MAX_CLUSTER_NODES 32      // 4 bordas * no máximo 8 transições cada
+#define PATH_GRAPH_MAGIC "ZHPA"
+#define PATH_GRAPH_VERSION 1
+
+#define ARENA_ALIGNMENT 16
+#define MEMORY_BUDGET_FILE "memoria.cfg"
+#define MEMORY_REPORT_FILE "memoria.txt"
+
+#define TELEMETRY_FILE "telemetria.jsonl"
+#define TELEMETRY_BATCH 4
+#define TELEMETRY_BUFFER_SIZE 16384
+#define TELEMETRY_RECORD_SIZE 1024
+#define TELEMETRY_BUCKETS 8
+#define TELEMETRY_WORST_FRAMES 5
+
+#define FLIGHT_FRAMES 600
+#define FLIGHT_EVENTS 128
+#define FLIGHT_EVENT_LENGTH 56
+#define HITCH_BUDGET_MS 25.0f
+#define HITCH_COOLDOWN 5.0
+#define HITCH_DIRECTORY "hitches"
+#define FRAME_ARENA_SIZE (256 << 10)
+
+#define CHECKSUM_LOG_FILE "checksums.log"
+#define SIM_RECORD_MAGIC "ZREC"
+#define SIM_RECORD_VERSION 1
+#define SIM_RECORD_FLUSH (64 << 10)
+#define SIM_DIFF_ITEMS 8
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#define PACK_FILENAME "zinf.pak"
+#define PACK_MAGIC "ZPAK"
+#define PACK_VERSION 1
+#define PACK_NAME_LENGTH 112
+#define PACK_ALIGNMENT 64
 
 typedef enum {
     PAUSE_CONTINUE,
@@ -45,828 +188,6666 @@ typedef struct {
     int spacing;
 } Menu;
 
+// Item do mapa ('V' vida, 'T' facas de arremesso ou a letra de uma arma, ver
+// attackDefs), na posição inicial
+typedef struct {
+    int row, col;
+    char type;
+} Item;
+
+// Monstro do mapa ('M' corpo a corpo, 'R' atira), na posição inicial
+typedef struct {
+    int row, col;
+    bool ranged;
+} MonsterSpawn;
+
+// Cluster do grafo de caminhos: os nós são as células de transição nas suas
+// bordas, e dist guarda a distância dentro do cluster entre cada par deles
+typedef struct {
+    int firstNode, nodeCount;
+    size_t firstDist;            // nodeCount * nodeCount entradas em dist
+    uint64_t terrainHash;        // para reaproveitar o cluster de um .hpa antigo
+} PathCluster;
+
+// Grafo abstrato do HPA*: o terreno dividido em clusters de
+// PATH_CLUSTER_SIZE, com as entradas entre clusters vizinhos como nós.
+// Arestas entre clusters ligam células vizinhas de clusters diferentes (custo
+// 1) e não vão para o .hpa: links sai da busca binária nos nós do vizinho
+typedef struct {
+    int clusterRows, clusterCols;
+    PathCluster *clusters;
+    int32_t *nodes;              // célula (linha * cols + coluna), por cluster e por célula
+    int32_t *links;              // 2 por nó: nós colados do outro lado da borda, ou -1
+    int nodeCount;
+    uint16_t *dist;              // UINT16_MAX = sem caminho dentro do cluster
+    size_t distCount;
+    int rebuiltClusters;         // clusters calculados no último build (o resto veio do .hpa)
+} PathGraph;
+
+typedef struct {
+    int32_t f, g, node;
+} PathOpen;
+
+// Estado de um nó na busca, junto para cada vizinho custar um acesso só
+typedef struct {
+    uint32_t stamp;
+    int32_t g;                   // distância até o destino
+    int32_t next;                // próximo nó rumo ao destino; -1 = já no cluster do destino
+} PathVisit;
+
+// Busca reversa (do destino para as partidas) retomável: consultas seguidas
+// para o mesmo destino, como as de todos os monstros atrás do jogador num
+// tick, continuam a mesma busca em vez de começar de novo. Os nós valem só
+// na geração atual, então nada precisa ser zerado ao trocar de destino
+typedef struct {
+    const PathGraph *graph;      // busca em andamento (NULL = nenhuma)
+    int32_t goal;
+    PathVisit *visits;
+    int capacity;
+    uint32_t generation;
+    PathOpen *open;              // heap binário, com entradas velhas descartadas ao sair
+    int openCount, openCapacity;
+    uint16_t fromDist[PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE];
+    uint16_t toDist[PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE];
+    int16_t fromParent[PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE];
+    int32_t queue[PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE];
+} PathSearch;
+
+// Dados imutáveis de um mapa, lidos uma vez do arquivo e compartilhados pelo
+// cache: o terreno (paredes e chão) e onde cada entidade começa. Jogador,
+// monstros e itens coletados vivem na GameSession, então nada aqui é escrito
+// durante a fase e o que for derivado do terreno nunca precisa ser refeito
+typedef struct {
+    char name[MAP_NAME_LENGTH];
+    int rows, cols;
+    char *terrain;
+    Item *items;            // ordenados pela célula (linha * cols + coluna)
+    int itemCount;
+    int playerRow, playerCol;
+    MonsterSpawn *monsters;  // na ordem de leitura, que é a ordem da fila da IA
+    int monsterCount;
+    PathGraph paths;
+} Map;
+
+typedef struct {
+    Map map;
+    int refs;
+    unsigned lastUse;
+} CachedMap;
+
+#define TERRAIN_AT(map, r, c) ((map)->terrain[(r) * (map)->cols + (c)])
+
+// Intervalo de tiles visíveis pela câmera (inclusivo)
+typedef struct {
+    int firstRow, lastRow;
+    int firstCol, lastCol;
+} TileRange;
+
+// Alvo de baixa resolução para a área de jogo (escala 1 desenha direto na tela)
+typedef struct {
+    int scale;
+    RenderTexture2D target;
+} LowResRenderer;
+
+// Formas de ataque; cada arma do mapa dá uma delas ao jogador
+typedef enum {
+    ATTACK_LINE,
+    ATTACK_ARC,
+    ATTACK_CONE,
+    ATTACK_BURST,
+    ATTACK_KIND_COUNT
+} AttackKind;
+
+// Definição de uma arma: o padrão é desenhado virado para cima, com '@' no
+// jogador e '#' nas células atingidas, numa grade ATTACK_GRID x ATTACK_GRID
+typedef struct {
+    const char *name;
+    char item;
+    Color color;
+    const char *pattern[ATTACK_GRID];
+} AttackDef;
+
+// Padrão pré-calculado para cada direção (cima, baixo, esquerda, direita):
+// "offsets" lista as células atingidas em relação ao jogador, usadas tanto
+// para achar os monstros (pelo índice de ocupação) quanto para o desenho
+typedef struct {
+    int offsetCount;
+    signed char offsets[FACING_COUNT][ATTACK_GRID * ATTACK_GRID][2];
+} AttackTemplate;
+
+// x/y é o centro do corpo em tiles * FIXED_ONE; row/col é a célula desse
+// centro, usada por itens, ataques e contato. prevX/prevY é a posição no
+// começo do tick, só para interpolar o desenho entre dois ticks
 typedef struct {
     int row, col;
+    int32_t x, y;
+    int32_t prevX, prevY;
     int score, lives, level;
     bool swordActive;
+    AttackKind weapon;
+    int throwables;
     bool isBlinking;
     int blinkFrames;
     int facingRow, facingCol;
+    float playTime;   // segundos jogados na partida, somando as fases
 } Player;
 
+// Golpe na tela: as células saem do template a partir da origem e direção
 typedef struct {
     int active;
     int frameCounter;
-    Vector2 tiles[3];
+    AttackKind kind;
+    int row, col;
+    int facing;
 } AttackEffect;
 
 typedef struct {
     int row, col, frameCounter;
 } MonsterDeath;
 
+// Uma animação por monstro no máximo: o vetor sai da arena da fase com
+// capacidade igual ao número de monstros do mapa
 typedef struct {
-    MonsterDeath deaths[MAX_DEATH_ANIMATIONS];
-    int count;
+    MonsterDeath *deaths;
+    int count, capacity;
 } MonsterDeathManager;
 
+// row/col é a célula lógica: ao decidir um passo o monstro já reserva a
+// célula de destino, e o corpo (x/y) desliza até ela em "steps" ticks
 typedef struct {
     int row, col;
     bool active;
+    bool ranged;
+    int cooldown;   // ticks até o próximo tiro (só monstros à distância)
+    int32_t x, y;
+    int32_t prevX, prevY;
+    int16_t vx, vy;
+    int steps;
 } Monster;
 
+typedef enum {
+    SHOT_MONSTER,
+    SHOT_PLAYER
+} ShotOwner;
+
+// Projéteis em SoA, num único bloco com um vetor por campo (posição em
+// tiles * FIXED_ONE, no centro do projétil; velocidade por tick, no máximo um
+// tile por eixo). Os vivos ficam em [0, count) e remover troca com o último,
+// então a ordem só depende da simulação e atirar nunca aloca
 typedef struct {
-    Monster monsters[MAX_MONSTERS];
-    int count;
+    int32_t *x, *y;
+    int16_t *vx, *vy;
+    uint16_t *life;
+    uint8_t *owner;
+    int count, capacity;
+} ProjectilePool;
+
+// Vivos em [0, count); o vetor vem da arena da fase, com capacidade igual ao
+// número de monstros do mapa (a contagem só diminui durante a fase). cells
+// guarda, por célula do mapa, o índice + 1 do monstro ativo ali (0 = livre),
+// para achar quem ocupa um tile sem varrer o vetor
+typedef struct {
+    Monster *monsters;
+    int count, capacity;
+    int32_t *cells;
+    int rows, cols;
 } MonsterManager;
 
+#define MONSTER_CELL(manager, r, c) ((manager)->cells[(r) * (manager)->cols + (c)])
+
 typedef struct {
     char name[NAME_LENGTH];
     int score;
 } HighScore;
 
-// Protótipos de função
-void LoadMapFromFile(char map[ROWS][COLS], const char *filename);
-bool RunGame(const char *mapFile, Player *player);
-void InitMenu(Menu *menu);
-void DrawMenu(Menu *menu, int screenWidth, int screenHeight);
-void UpdateMenu(Menu *menu, int screenWidth, int screenHeight, Sound hoverSound, float deltaTime);
-void LocatePlayer(char map[ROWS][COLS], Player *player);
-void UpdatePlayer(char map[ROWS][COLS], Player *player);
-void DrawHUD(const Player *player);
-void PerformSwordAttack(char map[ROWS][COLS], Player *player, AttackEffect *effect, MonsterDeathManager *deathManager, MonsterManager *monsterManager);
-void DrawMap(char map[ROWS][COLS], const Player *player, int frameCount);
-void DrawMonsterDeaths(MonsterDeathManager *deaths);
-void InitializeMonsters(char map[ROWS][COLS], MonsterManager *monsterManager);
-void UpdateMonsters(char map[ROWS][COLS], MonsterManager *monsterManager, Player *player);
-void RemoveMonsterAt(MonsterManager *manager, int row, int col);
-void LoadHighScores(HighScore scores[MAX_SCORES], const char *filename);
-void SaveHighScores(HighScore scores[MAX_SCORES], const char *filename);
-int UpdateHighScores(HighScore scores[MAX_SCORES], const char *filename, int newScore);
-void ShowHighScores(const char *filename);
-void ShowVictoryScreen(Player player, int topPosition);
-int CheckHighScorePosition(HighScore scores[MAX_SCORES], int newScore);
-PauseAction ShowPauseMenu();
-void SaveGame(const Player *player, const char *filename);
-void SaveGameSlot(Player *player, int slot);
-bool LoadGameSlot(Player *player, int slot);
-int ChooseSaveSlot(const char *prompt);
-void DrawBlurredTexture(Texture2D texture, int screenWidth, int screenHeight);
-void CreateGameDirectory(const char *path);
+typedef enum {
+    SLOT_LOAD,
+    SLOT_SAVE
+} SlotMode;
 
-int main(void) {
-    const int screenWidth = SCREENWIDTH;
-    const int screenHeight = SCREENHEIGHT;
+typedef enum {
+    MESSAGE_NONE,
+    MESSAGE_NEXT_LEVEL
+} MessageAction;
 
-    InitWindow(screenWidth, screenHeight, "ZINF - Trabalho Final");
-    InitAudioDevice();
-    SetTargetFPS(60);
+// Gerador próprio (xorshift32) para o estado aleatório poder ser salvo
+typedef struct {
+    uint32_t state;
+} GameRng;
 
-    // Criar diretórios necessários
-    CreateGameDirectory("saves");
+// Subsistemas para a contabilidade de memória. MEM_ARENAS é o espaço
+// reservado pelas arenas que ainda não foi entregue a ninguém
+typedef enum {
+    MEM_MAP,
+    MEM_MONSTERS,
+    MEM_EFFECTS,
+    MEM_REWIND,
+    MEM_TEXTURES,
+    MEM_AUDIO,
+    MEM_SAVES,
+    MEM_SCORES,
+    MEM_UI,
+    MEM_PACK,
+    MEM_ARENAS,
+    MEM_TAG_COUNT
+} MemTag;
 
-    Menu menu;
-    InitMenu(&menu);
+typedef struct {
+    int64_t bytes;
+    int64_t peak;
+    int blocks;
+    bool overBudget;
+} MemStats;
+
+// Alocador linear: cada bloco é um avanço de ponteiro dentro de um buffer
+// único, e tudo é devolvido de uma vez com ResetArena. "peak" guarda o maior
+// uso já visto, para dimensionar os tamanhos fixos; tagBytes diz a qual
+// subsistema cada parte do uso pertence
+typedef struct {
+    const char *name;
+    unsigned char *base;
+    size_t capacity, used, peak;
+    size_t tagBytes[MEM_TAG_COUNT];
+    int tagBlocks[MEM_TAG_COUNT];
+} Arena;
+
+// Buffer de bytes para o formato de save (inteiros em varint/zigzag, então o
+// arquivo não depende de endianness, padding nem sizeof(bool))
+typedef struct {
+    unsigned char *data;
+    size_t size, capacity;
+} ByteWriter;
 
-    Sound hoverSound = LoadSound("resources/hover.wav");
-    Texture2D background = LoadTexture("resources/background.png");
+typedef struct {
+    const unsigned char *data;
+    size_t size, pos;
+    bool error;
+} ByteReader;
+
+// Um tick gravado para o rewind: diff XOR (zeros em RLE) contra o keyframe
+// do grupo, ou, se for keyframe, contra o keyframe anterior. Os bytes ficam
+// no anel "pool" do RewindBuffer, a partir de "offset"
+typedef struct {
+    size_t offset, size;
+    bool keyframe;
+} RewindEntry;
+
+// Anel com os últimos REWIND_SECONDS de simulação. O estado de um tick é
+// itens + Player + MonsterManager + efeito de ataque + contadores/RNG (o
+// terreno é imutável e fica de fora), e só os bytes que mudaram ocupam memória. "base" é o keyframe mais antigo e "key" o
+// mais recente, ambos completos; o restante é diff. Os diffs ocupam o anel de
+// bytes "pool" na mesma ordem das entradas (head = mais antigo, tail = fim do
+// mais recente), então gravar um tick nunca chama o malloc
+typedef struct {
+    RewindEntry *entries;
+    int capacity, start, count;
+    int latestKey;
+    size_t stateSize;
+    unsigned char *base;
+    unsigned char *key;
+    unsigned char *pool;
+    size_t poolSize, head, tail;
+    size_t bytesUsed;
+    bool rewinding;
+} RewindBuffer;
 
-    bool inGame = false;
-    bool shouldClose = false;
-    Player player = {0};
+typedef struct {
+    float ms;
+    int tick;
+} FrameSample;
 
-    while (!WindowShouldClose() && !shouldClose) {
-        float deltaTime = GetFrameTime();
-
-        if (!inGame) {
-            UpdateMenu(&menu, screenWidth, screenHeight, hoverSound, deltaTime);
-
-            if (IsKeyPressed(KEY_ENTER)) {
-                switch (menu.selected) {
-                    case 0:
-                        player.lives = 3;
-                        player.score = 0;
-                        player.level = 1;
-                        inGame = true;
-                        break;
-                    case 1: {
-                        int slot = ChooseSaveSlot("Escolha um slot para CARREGAR");
-                        if (slot != -1 && LoadGameSlot(&player, slot)) {
-                            inGame = true;
-                        }
-                        break;
-                    }
-                    case 2:
-                        ShowHighScores("highscores_kl.bin");
-                        break;
-                    case 3:
-                        shouldClose = true;
-                        break;
-                }
-            }
+// Números de uma fase para a telemetria, acumulados a cada tick e fechados
+// no UnloadLevel. As perdas de vida e mortes contam só as quedas entre
+// ticks, então coletar itens ou voltar com o rewind não as desfaz
+typedef struct {
+    bool active;
+    bool completed;
+    char mapFile[MAP_NAME_LENGTH];
+    int64_t startedAt;
+    double loadTime;
+    float duration;
+    int startScore, score;
+    int lives, livesLost;
+    int monstersAlive, monstersKilled;
+    int frames;
+    int buckets[TELEMETRY_BUCKETS];
+    FrameSample worst[TELEMETRY_WORST_FRAMES];
+} LevelTelemetry;
 
-            BeginDrawing();
-            ClearBackground(BLACK);
-            DrawBlurredTexture(background, screenWidth, screenHeight);
-            DrawMenu(&menu, screenWidth, screenHeight);
-            EndDrawing();
-        } else {
-            char mapFile[32];
-            snprintf(mapFile, sizeof(mapFile), "mapa%02d.txt", player.level);
-
-            FILE *file = fopen(mapFile, "r");
-            if (!file) {
-                HighScore scores[MAX_SCORES];
-                LoadHighScores(scores, "highscores_kl.bin");
-                int topPos = CheckHighScorePosition(scores, player.score);
-                ShowVictoryScreen(player, topPos);
-
-                if (topPos != -1) {
-                    UpdateHighScores(scores, "highscores_kl.bin", player.score);
-                }
+typedef struct {
+    char text[TELEMETRY_BUFFER_SIZE];
+    size_t length;
+    int records;
+} TelemetryBatch;
 
-                inGame = false;
-                continue;
-            }
-            fclose(file);
+// Registros JSONL acumulados num lote; a cada TELEMETRY_BATCH fases o lote
+// vai para a thread, que anexa ao arquivo enquanto o outro lote enche
+typedef struct {
+    bool enabled;
+    bool quit;
+    TelemetryBatch batches[2];
+    int fillIndex;
+    int jobIndex;      // lote entregue à thread (-1 = nenhum)
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} TelemetryWriter;
 
-            bool gameRunning = RunGame(mapFile, &player);
-            if (!gameRunning) {
-                inGame = false;
-            } else {
-                player.level++;
-            }
-        }
-    }
+typedef enum {
+    INPUT_MOVE_UP,
+    INPUT_MOVE_DOWN,
+    INPUT_MOVE_LEFT,
+    INPUT_MOVE_RIGHT,
+    INPUT_ATTACK,
+    INPUT_THROW,
+    INPUT_PAUSE,
+    INPUT_EXIT,
+    INPUT_ACTION_COUNT
+} InputAction;
 
-    UnloadTexture(background);
-    UnloadSound(hoverSound);
-    CloseAudioDevice();
-    CloseWindow();
+typedef struct {
+    InputAction action;
+    double time;
+} InputEvent;
 
-    return 0;
-}
+// Nível de detalhe da IA pela distância ao jogador: perto (na tela) pensa
+// todo tick e segue o campo de distância da tela; no meio pensa pela fila e
+// segue o grafo de caminhos (HPA*); longe fica parado até o jogador se aproximar
+typedef enum {
+    AI_LOD_NEAR,
+    AI_LOD_MID,
+    AI_LOD_FAR,
+    AI_LOD_COUNT
+} AiLod;
+
+// Distâncias em passos até o jogador numa janela do mapa em volta dele.
+// Vive na frameArena: é refeito a cada tick que alguém precisa
+typedef struct {
+    int firstRow, firstCol;
+    int rows, cols;
+    uint16_t *dist;     // UINT16_MAX = inalcançável dentro da janela
+} DistanceField;
+
+// Fila circular dos pensamentos dos monstros. Cada tick soma "count" ao
+// acúmulo e cada pensamento gasta MONSTER_MOVE_INTERVAL, então cada monstro
+// pensa em média uma vez a cada MONSTER_MOVE_INTERVAL ticks, mas o trabalho
+// fica espalhado pelos ticks em vez de cair todo no mesmo. O que o orçamento
+// do tick não cobriu continua no acúmulo para os próximos
+typedef struct {
+    int cursor;     // próximo monstro a pensar
+    int backlog;    // trabalho pendente em monstros * ticks
+} AiScheduler;
 
-void CreateGameDirectory(const char *path) {
-    #if defined(_WIN32)
-    _mkdir(path);
-    #else
-    mkdir(path, 0777);
-    #endif
-}
+// Orçamento de tempo da IA. Fica fora da simulação: o relógio só decide
+// quantos pensamentos cabem no tick, e esse limite vai na gravação junto com
+// as ações, então o replay refaz exatamente o mesmo trabalho
+typedef struct {
+    double budgetUs;    // por frame
+    double thinkUs;     // custo médio de um pensamento (média móvel)
+    double spentUs;     // gasto no frame atual
+    double lastUs;      // gasto no último tick
+    int lastThinks;
+    int lodCounts[AI_LOD_COUNT];   // monstros em cada nível no último tick
+} AiBudget;
+
+// Estado da fase em andamento. Tudo que vive só durante a fase sai de
+// levelArena (descartada de uma vez no UnloadLevel); frameArena é zerada a
+// cada tick e serve para buffers temporários da simulação
+typedef struct {
+    bool active;
+    Arena levelArena;
+    Arena frameArena;
+    char mapFile[MAP_NAME_LENGTH];
+    const Map *map;
+    unsigned char *itemActive;   // camada dinâmica dos itens: 1 = ainda no mapa
+    GameRng rng;
+    AttackEffect attackEffect;
+    MonsterDeathManager deathManager;
+    MonsterManager monsterManager;
+    LowResRenderer renderer;
+    int frameCount;
+    AiScheduler ai;
+    uint64_t itemHash;           // XOR das chaves dos itens ainda no mapa
+    ProjectilePool projectiles;
+    float tickAccumulator;       // tempo de frame ainda não simulado
+    float tickAlpha;             // fração do próximo tick, para o desenho
+    InputEvent pendingEvents[MAX_PENDING_ACTIONS];     // teclas à espera do próximo tick
+    int pendingCount;
+    RewindBuffer rewind;
+    LevelTelemetry telemetry;
+} GameSession;
+
+// Arquivo de pacote: cabeçalho, índice ordenado por nome e os dados de cada
+// entrada alinhados em PACK_ALIGNMENT bytes. Lido inteiro com um único mmap
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+} PackHeader;
 
-void DrawBlurredTexture(Texture2D texture, int screenWidth, int screenHeight) {
-    Vector2 pos = {0, 0};
-    Rectangle sourceRec = {0, 0, (float)texture.width, (float)-texture.height};
-    Color tint = (Color){255, 255, 255, 30};
+typedef struct {
+    char name[PACK_NAME_LENGTH];
+    uint64_t offset;
+    uint64_t size;
+} PackEntry;
 
-    for (int y = -2; y <= 2; y++) {
-        for (int x = -2; x <= 2; x++) {
-            DrawTextureRec(texture, sourceRec, (Vector2){pos.x + x, pos.y + y}, tint);
-        }
-    }
-}
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const PackEntry *entries;
+    int entryCount;
+} Pack;
 
-void InitMenu(Menu *menu) {
-    menu->options[0] = "1. Novo Jogo";
-    menu->options[1] = "2. Carregar Jogo";
-    menu->options[2] = "3. Scoreboard";
-    menu->options[3] = "4. Sair";
-    menu->selected = 0;
-    menu->fontSize = 40;
-    menu->spacing = 60;
-}
+typedef struct {
+    char **paths;
+    int count, capacity;
+} PackFileList;
 
-void DrawMenu(Menu *menu, int screenWidth, int screenHeight) {
-    const char *title = "ZINF";
-    int baseFontSize = 80;
-    int titleY = screenHeight / 4;
+typedef enum {
+    ASSET_TEXTURE,
+    ASSET_SOUND
+} AssetType;
 
-    float scale = 1.0f;
-    int scaledFontSize = (int)(baseFontSize * scale);
+typedef enum {
+    ASSET_FREE,
+    ASSET_QUEUED,    // aguardando um worker decodificar
+    ASSET_DECODED,   // Image/Wave em RAM, falta enviar para GPU/áudio
+    ASSET_FAILED
+} AssetState;
+
+// state/image/wave são escritos pelos workers (sob lock); ready/texture/sound
+// só pela thread principal
+typedef struct {
+    AssetType type;
+    AssetState state;
+    int refCount;
+    bool ready;
+    bool done;
+    char path[ASSET_PATH_LENGTH];
+    Image image;
+    Wave wave;
+    Texture2D texture;
+    Sound sound;
+} Asset;
+
+// Índice + 1 no registro; 0 significa "nenhum asset"
+typedef int AssetHandle;
 
-    int textWidth = MeasureText(title, scaledFontSize);
-    int textX = (screenWidth - textWidth) / 2;
+typedef struct {
+    Asset assets[MAX_ASSETS];
+    int queue[MAX_ASSETS];
+    int queueHead, queueCount;
+    int pending;
+    bool quit;
+    pthread_t workers[ASSET_WORKERS];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} AssetManager;
+
+// Cópia do estado da fase para o autosave; itens e mapa são da própria cópia
+// (o mapa só com os campos escalares), então a fase pode seguir ou ser
+// descarregada durante a gravação
+typedef struct {
+    GameSession game;
+    Map map;
+    Player player;
+    size_t itemCapacity;
+    int deathCapacity;
+    int monsterCapacity;
+    unsigned char *shotData;
+    int shotCapacity;
+} SaveSnapshot;
+
+// Resumo de um slot para o navegador de saves: lido de um índice único,
+// sem abrir nem decodificar os arquivos de save
+typedef struct {
+    bool used;
+    bool hasPreview;
+    int level, score, lives;
+    int playTime;
+    int64_t savedAt;
+    char mapFile[MAP_NAME_LENGTH];
+    char thumbnail[THUMB_WIDTH * THUMB_HEIGHT];   // tiles ao redor do jogador
+} SlotInfo;
 
-    DrawText(title, textX, titleY, scaledFontSize, TITLE_COLOR);
+typedef struct {
+    SlotInfo slots[MAX_SAVE_SLOTS + 1];   // 0 = autosave
+} SlotIndex;
 
-    for (int i = 0; i < 4; i++) {
-        int optionWidth = MeasureText(menu->options[i], menu->fontSize);
-        int optionX = (screenWidth - optionWidth) / 2;
-        int optionY = titleY + 150 + i * menu->spacing;
+// Dois snapshots: o principal preenche um enquanto a thread grava o outro
+typedef struct {
+    SaveSnapshot snapshots[2];
+    int fillIndex;
+    int jobIndex;        // snapshot entregue à thread (-1 = nenhum)
+    bool busy;
+    bool saving;         // cópia de busy da thread principal, lida sem o lock pelo desenho
+    bool finished;
+    bool lastResult;
+    bool quit;
+    float timer;
+    float toastTime;
+    bool toastOk;
+    SlotInfo pendingInfo;   // vai para o índice quando a thread confirmar a gravação
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} AutoSaver;
+
+// Registro do log de pontuações (só cresce); no disco ocupa SCORE_RECORD_SIZE
+// bytes (ver PackScoreRecord). "previous" encadeia as partidas do mesmo
+// jogador para consultar o histórico sem varrer o log
+typedef struct {
+    int64_t time;
+    int64_t previous;
+    int32_t score;
+    int32_t level;
+    char name[NAME_LENGTH];
+} ScoreRecord;
 
-        if (i == menu->selected) {
-            DrawRectangleLines(optionX - 20, optionY - 10, optionWidth + 40, menu->fontSize + 20, RAYWHITE);
-            DrawText(menu->options[i], optionX, optionY, menu->fontSize, RAYWHITE);
-        } else {
-            DrawText(menu->options[i], optionX, optionY, menu->fontSize, MENU_COLOR);
-        }
-    }
+// Min-heap com as SCORE_TOP_N maiores pontuações: a raiz é a menor do top
+typedef struct {
+    HighScore entries[SCORE_TOP_N];
+    int count;
+} ScoreHeap;
 
-    const char *footer = "UFRGS - Algoritmos e Programacao 2025";
-    DrawText(footer, (screenWidth - MeasureText(footer, 20)) / 2, screenHeight - 40, 20, GRAY);
-}
+typedef struct {
+    char name[NAME_LENGTH];
+    int best;
+    int bestLevel;
+    int games;
+    int64_t lastRecord;
+} PlayerStats;
 
-void UpdateMenu(Menu *menu, int screenWidth, int screenHeight, Sound hoverSound, float deltaTime) {
-    static int lastHovered = -1;
-    bool hoveringAny = false;
+// Tabela hash de endereçamento aberto; nome vazio marca posição livre
+typedef struct {
+    PlayerStats *slots;
+    int capacity;
+    int count;
+} PlayerTable;
 
-    if (IsKeyPressed(KEY_DOWN)) {
-        menu->selected = (menu->selected + 1) % 4;
-        PlaySound(hoverSound);
-    } else if (IsKeyPressed(KEY_UP)) {
-        menu->selected = (menu->selected - 1 + 4) % 4;
-        PlaySound(hoverSound);
-    }
+// O log guarda todas as partidas; o índice compactado (tops por fase, geral
+// e estatísticas por jogador) é regravado a cada SCORE_COMPACT_INTERVAL
+// registros, e ao abrir só a cauda do log depois dele é reprocessada
+typedef struct {
+    FILE *log;
+    ScoreHeap top[SCORE_LEVELS];   // 0 = geral, 1.. = fase alcançada
+    PlayerTable players;
+    int64_t recordCount;
+    int64_t indexedCount;
+} ScoreBoard;
 
-    if (IsKeyPressed(KEY_ONE)) { menu->selected = 0; PlaySound(hoverSound); }
-    if (IsKeyPressed(KEY_TWO)) { menu->selected = 1; PlaySound(hoverSound); }
-    if (IsKeyPressed(KEY_THREE)) { menu->selected = 2; PlaySound(hoverSound); }
-    if (IsKeyPressed(KEY_FOUR)) { menu->selected = 3; PlaySound(hoverSound); }
+typedef enum {
+    SFX_HOVER,
+    SFX_ATTACK,
+    SFX_MONSTER_DEATH,
+    SFX_PICKUP,
+    SFX_HURT,
+    SFX_COUNT
+} SoundId;
 
-    Vector2 mousePos = GetMousePosition();
-    int titleY = screenHeight / 4;
+typedef struct {
+    const char *path;
+    float pitch;
+    int maxVoices;
+    int priority;
+} SoundDef;
 
-    for (int i = 0; i < 4; i++) {
-        int optionWidth = MeasureText(menu->options[i], menu->fontSize);
-        int optionX = (screenWidth - optionWidth) / 2;
-        int optionY = titleY + 150 + i * menu->spacing;
+// Vozes pré-alocadas (aliases que compartilham os dados do som original)
+typedef struct {
+    AssetHandle asset;
+    Sound voices[MAX_VOICES_PER_SOUND];
+    int voiceCount;
+    int nextVoice;
+} SoundPool;
 
-        Rectangle optionBounds = { (float)optionX, (float)optionY, (float)optionWidth, (float)menu->fontSize };
+typedef struct {
+    SoundId id;
+    bool positional;
+    int row, col;
+} SoundEvent;
 
-        if (CheckCollisionPointRec(mousePos, optionBounds)) {
-            hoveringAny = true;
-            SetMouseCursor(MOUSE_CURSOR_POINTING_HAND);
+typedef struct {
+    SoundPool pools[SFX_COUNT];
+    SoundEvent events[MAX_SOUND_EVENTS];
+    int eventCount;
+    int listenerRow, listenerCol;
+} SoundSystem;
+
+// Fila de eventos do frame: preenchida uma vez no começo do frame, na ordem
+// em que as teclas foram pressionadas, e consumida antes da simulação
+typedef struct {
+    InputEvent events[MAX_INPUT_EVENTS];
+    int count;
+    bool held[INPUT_MOVE_RIGHT + 1];         // direções seguradas no frame
+    double appliedTime;                      // evento mais antigo aplicado no frame (0 = nenhum)
+    float latency[LATENCY_HISTORY];          // ms entre a coleta e o present
+    int latencyCount, latencyNext;
+    bool showLatency;
+} InputQueue;
+
+// Registros do arquivo de gravação da simulação
+typedef enum {
+    SIM_RECORD_SNAPSHOT = 1,
+    SIM_RECORD_TICK = 2
+} SimRecordType;
+
+// Gravação opcional para verificar o determinismo. Cada trecho começa com o
+// estado completo no formato do save (no início da fase, ao carregar um save
+// e depois de um rewind) e segue com um registro por tick: as ações
+// aplicadas, o checksum e o diff XOR/RLE do estado contra o tick anterior,
+// que é o que permite mostrar o que divergiu e não só em que tick
+typedef struct {
+    FILE *log;
+    FILE *file;
+    bool synced;
+    ByteWriter out;
+    ByteWriter delta;
+    unsigned char *previous, *current;
+    size_t stateCapacity;
+} SimRecorder;
+
+typedef struct App App;
+typedef struct Scene Scene;
+
+// Cada tela é uma cena na pilha: só a do topo recebe update, e as cenas
+// marcadas como overlay deixam a de baixo aparecer no draw. Cenas idle só
+// mudam com entrada do usuário, então o laço dorme até chegar um evento
+struct Scene {
+    const char *name;
+    void (*update)(Scene *scene, App *app);
+    void (*draw)(const Scene *scene, const App *app);
+    bool overlay;
+    bool idle;
+    union {
+        struct { int selected; } pause;
+        struct { SlotMode mode; int selected; } slot;
+        struct { int level, selected, historyCount; bool dirty; PlayerStats stats; ScoreRecord history[SCORE_HISTORY_LENGTH]; } highScores;
+        struct { int score, level, topPosition; } victory;
+        struct { int score, level, position, letterCount; char name[NAME_LENGTH]; } nameEntry;
+        struct { char text[64]; Color background, color; int fontSize; float remaining; MessageAction action; } message;
+    } state;
+};
+
+struct App {
+    Scene scenes[MAX_SCENES];
+    int sceneCount;
+    bool shouldClose;
+    Menu menu;
+    InputQueue input;
+    AssetManager assets;
+    SoundSystem sounds;
+    AutoSaver autosave;
+    SlotIndex slotIndex;
+    ScoreBoard scores;
+    AssetHandle background;
+    Player player;
+    GameSession game;
+    bool showMemory;
+};
 
-            if (lastHovered != i) {
-                PlaySound(hoverSound);
-                lastHovered = i;
-            }
+typedef enum {
+    PHASE_ASSETS,
+    PHASE_INPUT,
+    PHASE_UPDATE,
+    PHASE_SOUND,
+    PHASE_DRAW,
+    PHASE_PRESENT,
+    PHASE_COUNT
+} FramePhase;
 
-            menu->selected = i;
-        }
+typedef struct {
+    int64_t index;
+    double start;
+    float phaseMs[PHASE_COUNT];
+    float totalMs;
+    short monsters;   // -1 fora de uma fase
+    bool idle;        // o present podia dormir (espera de evento ou fps reduzido)
+} FrameRecord;
+
+typedef struct {
+    double time;
+    int64_t frame;
+    char text[FLIGHT_EVENT_LENGTH];
+} FlightEvent;
+
+// Estado do jogo no momento do hitch
+typedef struct {
+    char scene[16];
+    int sceneCount;
+    bool inLevel;
+    char mapFile[MAP_NAME_LENGTH];
+    int tick, playerRow, playerCol, lives, score, monsters;
+    bool rewinding, autosaveBusy, assetsPending;
+    int64_t memoryBytes;
+} FlightSummary;
+
+// Cópia cronológica dos anéis entregue à thread que grava o arquivo
+typedef struct {
+    FrameRecord frames[FLIGHT_FRAMES];
+    int frameCount;
+    FlightEvent events[FLIGHT_EVENTS];
+    int eventCount;
+    FlightSummary summary;
+    float budgetMs;
+    char filename[96];
+} FlightDump;
+
+// Gravador de voo: os últimos FLIGHT_FRAMES frames com o tempo de cada fase
+// do laço e os últimos eventos (fases, saves, telas). Um frame acima do
+// orçamento copia tudo para "dump" e a thread grava em HITCH_DIRECTORY
+typedef struct {
+    bool started;
+    FrameRecord frames[FLIGHT_FRAMES];
+    int frameNext, frameCount;
+    FlightEvent events[FLIGHT_EVENTS];
+    int eventNext, eventCount;
+    FrameRecord current;
+    double phaseStart;
+    float budgetMs;
+    double lastDump;
+    FlightDump dump;
+    bool busy;
+    bool quit;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} FlightRecorder;
+
+// Protótipos de função
+bool LoadMapFromFile(Map *map, const char *filename);
+void UnloadMap(Map *map);
+const Map *AcquireMap(const char *name, double *loadTime);
+bool BuildPathGraph(PathGraph *graph, const Map *map, const PathGraph *stored);
+bool AbortPathGraph(PathGraph *graph, const Map *map);
+int BorderTransitions(const Map *map, int clusterRow, int clusterCol, int side, int32_t *out);
+uint64_t ClusterTerrainHash(const Map *map, int clusterRow, int clusterCol);
+void ClusterBfs(const Map *map, int clusterRow, int clusterCol, int32_t cell, uint16_t *dist, int16_t *parent, int32_t *queue);
+int FindPathNode(const PathGraph *graph, int cluster, int32_t cell);
+int FindPathStep(const PathGraph *graph, const Map *map, int fromRow, int fromCol, int toRow, int toCol, int *stepRow, int *stepCol);
+bool EnsurePathSearch(PathSearch *search, int nodeCount);
+void RekeyPathSearch(PathSearch *search, const Map *map, int fromRow, int fromCol);
+void PushPathOpen(PathSearch *search, PathOpen entry);
+PathOpen PopPathOpen(PathSearch *search);
+void SiftPathOpen(PathSearch *search, int index);
+void FreePathSearch(PathSearch *search);
+size_t PathGraphBytes(const PathGraph *graph);
+void FreePathGraph(PathGraph *graph);
+void GetPathGraphFilename(const char *mapName, char *out, size_t size);
+bool SavePathGraph(const PathGraph *graph, const Map *map, const char *filename);
+bool LoadPathGraph(PathGraph *graph, const Map *map, const char *filename);
+int BuildPathGraphFiles(char **maps, int count);
+double MonotonicTime(void);
+void ReleaseMap(const Map *map);
+void FreeMapCache(void);
+int FindItemAt(const Map *map, int row, int col);
+int MonsterAt(const MonsterManager *monsterManager, int row, int col);
+void RebuildMonsterCells(MonsterManager *monsterManager);
+Camera2D UpdateGameCamera(const Map *map, Vector2 focus, int renderScale);
+Vector2 InterpolateBody(int32_t prevX, int32_t prevY, int32_t x, int32_t y, float alpha);
+bool MoveBody(const Map *map, int32_t *x, int32_t *y, int dx, int dy, int half);
+bool BoxHitsWall(const Map *map, int32_t x, int32_t y, int half);
+void MoveMonsters(const Map *map, MonsterManager *monsterManager);
+bool RunGameTick(App *app, const InputAction *actions, int actionCount);
+TileRange GetVisibleTiles(Camera2D camera, const Map *map);
+void SetRenderScale(LowResRenderer *renderer, int scale);
+void CycleRenderScale(LowResRenderer *renderer);
+void UnloadLowResRenderer(LowResRenderer *renderer);
+void PushScene(App *app, Scene scene);
+void PopScene(App *app);
+void ReplaceScene(App *app, Scene scene);
+void PopToMenu(App *app);
+void DrawScenes(const App *app);
+bool UpdateFramePacing(const App *app);
+void StartLevel(App *app);
+bool LoadLevel(GameSession *game, const char *mapFile, Player *player);
+void AbortLevelLoad(GameSession *game, const char *mapFile);
+void UnloadLevel(GameSession *game);
+size_t LevelArenaSize(const Map *map);
+void FreeLevelMemory(GameSession *game);
+bool ReserveArena(Arena *arena, const char *name, size_t capacity);
+void *ArenaAlloc(Arena *arena, size_t size, MemTag tag);
+void ResetArena(Arena *arena);
+void FreeArena(Arena *arena);
+size_t ArenaAligned(size_t size);
+void TrackMemory(MemTag tag, int64_t bytes, int blocks);
+void GetMemoryStats(MemStats out[MEM_TAG_COUNT]);
+void LoadMemoryBudgets(const char *filename);
+bool WriteMemoryReport(const char *filename, const GameSession *game);
+void DrawMemoryStats(const GameSession *game);
+void InitTelemetry(TelemetryWriter *writer, bool enabled);
+void ShutdownTelemetry(TelemetryWriter *writer);
+void BeginLevelTelemetry(LevelTelemetry *level, const GameSession *game, const Player *player, double loadTime);
+void RecordFrameTelemetry(LevelTelemetry *level, float deltaTime);
+void UpdateLevelTelemetry(LevelTelemetry *level, const GameSession *game, const Player *player);
+int CountActiveMonsters(const MonsterManager *monsterManager);
+int FormatLevelTelemetry(char *out, size_t size, const LevelTelemetry *level);
+void SubmitLevelTelemetry(TelemetryWriter *writer, const LevelTelemetry *level);
+void *TelemetryWorker(void *arg);
+void InitFlightRecorder(FlightRecorder *recorder, float budgetMs);
+void ShutdownFlightRecorder(FlightRecorder *recorder);
+void BeginFlightFrame(FlightRecorder *recorder, const App *app);
+void MarkFlightPhase(FlightRecorder *recorder, FramePhase phase);
+void RecordFlightEvent(FlightRecorder *recorder, const char *text);
+void CaptureFlightSummary(FlightSummary *summary, const App *app);
+void TriggerHitchDump(FlightRecorder *recorder, const App *app);
+bool WriteFlightDump(const FlightDump *dump);
+void *FlightRecorderWorker(void *arg);
+size_t TextureBytes(Texture2D texture);
+size_t SoundBytes(Sound sound);
+void FinishGame(App *app);
+Scene MenuScene(void);
+void UpdateMenuScene(Scene *scene, App *app);
+void DrawMenuScene(const Scene *scene, const App *app);
+Scene GameScene(void);
+void UpdateGameScene(Scene *scene, App *app);
+void DrawGameScene(const Scene *scene, const App *app);
+Scene PauseScene(void);
+void UpdatePauseScene(Scene *scene, App *app);
+void DrawPauseScene(const Scene *scene, const App *app);
+Scene SaveSlotScene(SlotMode mode);
+void UpdateSaveSlotScene(Scene *scene, App *app);
+void DrawSaveSlotScene(const Scene *scene, const App *app);
+Scene HighScoresScene(void);
+void UpdateHighScoresScene(Scene *scene, App *app);
+void DrawHighScoresScene(const Scene *scene, const App *app);
+Scene VictoryScene(int score, int level, int topPosition);
+void UpdateVictoryScene(Scene *scene, App *app);
+void DrawVictoryScene(const Scene *scene, const App *app);
+Scene NameEntryScene(int score, int level, int position);
+void UpdateNameEntryScene(Scene *scene, App *app);
+void DrawNameEntryScene(const Scene *scene, const App *app);
+Scene MessageScene(const char *text, Color background, Color color, int fontSize, float duration, MessageAction action);
+void UpdateMessageScene(Scene *scene, App *app);
+void DrawMessageScene(const Scene *scene, const App *app);
+void InitMenu(Menu *menu);
+void DrawMenu(const Menu *menu, int screenWidth, int screenHeight);
+void UpdateMenu(Menu *menu, int screenWidth, int screenHeight, SoundSystem *sounds, float deltaTime);
+void LocatePlayer(const Map *map, Player *player);
+void UpdatePlayer(GameSession *game, Player *player, int dirRow, int dirCol, SoundSystem *sounds);
+void DrawHUD(const Player *player, int renderScale);
+void DrawWorld(const GameSession *game, const Player *player, Camera2D camera);
+int PerformAttack(Player *player, AttackEffect *effect, MonsterDeathManager *deathManager, MonsterManager *monsterManager, SoundSystem *sounds);
+void CompactMonsters(MonsterManager *monsterManager, AiScheduler *ai);
+void BuildAttackTemplates(void);
+int AttackKindForItem(char item);
+int FacingIndex(int facingRow, int facingCol);
+void HurtPlayer(Player *player, SoundSystem *sounds);
+size_t ProjectileArraysBytes(int capacity);
+void BindProjectileArrays(ProjectilePool *pool, unsigned char *block, int capacity);
+void CopyProjectiles(ProjectilePool *dst, const ProjectilePool *src);
+bool SpawnProjectile(ProjectilePool *pool, int32_t x, int32_t y, int vx, int vy, ShotOwner owner);
+void RemoveProjectile(ProjectilePool *pool, int index);
+void FireRangedMonsters(GameSession *game, const Player *player, SoundSystem *sounds);
+void ThrowItem(GameSession *game, Player *player, SoundSystem *sounds);
+int UpdateProjectiles(GameSession *game, Player *player, SoundSystem *sounds);
+bool ProjectileStrikes(GameSession *game, Player *player, ShotOwner owner, int row, int col, int *kills, SoundSystem *sounds);
+void DrawProjectiles(const ProjectilePool *pool, TileRange view);
+void DrawMap(const GameSession *game, const Player *player, TileRange view);
+void UpdateMonsterDeaths(MonsterDeathManager *deaths);
+void DrawMonsterDeaths(const MonsterDeathManager *deaths, TileRange view);
+void InitializeMonsters(const Map *map, MonsterManager *monsterManager);
+void ThinkMonster(const Map *map, MonsterManager *monsterManager, int index, Player *player, GameRng *rng, SoundSystem *sounds);
+void ChaseMonster(const Map *map, MonsterManager *monsterManager, int index, Player *player, const DistanceField *field, SoundSystem *sounds);
+bool StepMonster(const Map *map, MonsterManager *monsterManager, Monster *m, int dRow, int dCol, Player *player, SoundSystem *sounds);
+AiLod MonsterLod(const Monster *m, const Player *player);
+bool BuildDistanceField(DistanceField *field, const Map *map, const Player *player, Arena *arena);
+int FieldDistance(const DistanceField *field, int row, int col);
+int RunAiScheduler(GameSession *game, Player *player, int limit, SoundSystem *sounds);
+int AiThinkLimit(const AiBudget *budget);
+void AccountAiTick(AiBudget *budget);
+void StepSimulation(GameSession *game, Player *player, const InputAction *actions, int actionCount, int aiLimit, SoundSystem *sounds);
+uint64_t HashValue(uint64_t hash, int64_t value);
+uint64_t ItemHashKey(const Map *map, int item);
+uint64_t HashItemLayer(const GameSession *game);
+uint64_t SimulationChecksum(const GameSession *game, const Player *player);
+bool OpenSimRecorder(SimRecorder *recorder, const char *logFile, const char *recordFile);
+void CloseSimRecorder(SimRecorder *recorder);
+void FlushSimRecorder(SimRecorder *recorder);
+void BreakSimRecording(SimRecorder *recorder);
+bool ReserveSimStates(SimRecorder *recorder, size_t stateSize);
+void BeginSimTick(SimRecorder *recorder, const GameSession *game, const Player *player);
+void RecordSimTick(SimRecorder *recorder, const GameSession *game, const Player *player, const InputAction *actions, int actionCount, int aiLimit, uint64_t checksum);
+bool VerifyRecording(const char *filename);
+void PrintStateDiff(const unsigned char *expected, const unsigned char *actual, const Map *map);
+void PrintFieldDiff(const char *name, int64_t expected, int64_t actual);
+void LoadHighScores(HighScore scores[MAX_SCORES], const char *filename);
+bool OpenScoreBoard(ScoreBoard *board);
+void CloseScoreBoard(ScoreBoard *board);
+bool AddScore(ScoreBoard *board, const char *name, int score, int level);
+void ApplyScoreRecord(ScoreBoard *board, const ScoreRecord *record, int64_t index);
+int ReplayScoreLog(ScoreBoard *board, int64_t first);
+void PushTopScore(ScoreHeap *heap, const char *name, int score);
+int GetTopScores(const ScoreBoard *board, int level, HighScore *out, int max);
+int GetScoreRank(const ScoreBoard *board, int level, int score);
+int CompareHighScores(const void *a, const void *b);
+PlayerStats *FindPlayerSlot(const PlayerTable *table, const char *name);
+PlayerStats *UpsertPlayer(PlayerTable *table, const char *name);
+void FreePlayerTable(PlayerTable *table);
+const PlayerStats *FindPlayerStats(const ScoreBoard *board, const char *name);
+int GetPlayerHistory(const ScoreBoard *board, const char *name, ScoreRecord *out, int max);
+void PackScoreRecord(const ScoreRecord *record, unsigned char *out);
+bool UnpackScoreRecord(const unsigned char *in, ScoreRecord *record);
+void PutLittleEndian(unsigned char *out, uint64_t value, int bytes);
+uint64_t GetLittleEndian(const unsigned char *in, int bytes);
+bool SaveScoreIndex(ScoreBoard *board);
+bool LoadScoreIndex(ScoreBoard *board);
+void SaveGame(const Player *player, const char *filename);
+bool SaveGameSlot(const GameSession *game, const Player *player, int slot, SlotIndex *index);
+bool LoadGameSlot(GameSession *game, Player *player, int slot);
+uint32_t RngNext(GameRng *rng);
+uint32_t Crc32(const unsigned char *data, size_t size);
+void WriteBytes(ByteWriter *w, const void *data, size_t size);
+void FreeByteWriter(ByteWriter *w);
+void WriteVarU(ByteWriter *w, uint64_t value);
+void WriteVarI(ByteWriter *w, int64_t value);
+uint64_t ReadVarU(ByteReader *r);
+int64_t ReadVarI(ByteReader *r);
+void ReadBytes(ByteReader *r, void *out, size_t size);
+void SealPayload(ByteWriter *w, const char *magic, int version);
+bool OpenPayload(const unsigned char *data, size_t size, const char *magic, int version, ByteReader *r);
+void EncodeGameState(ByteWriter *w, const GameSession *game, const Player *player);
+bool DecodeGameState(const unsigned char *data, size_t size, GameSession *game, Player *player);
+bool SavedCellValid(const Map *map, int row, int col);
+bool SavedBodyValid(const Map *map, int32_t x, int32_t y);
+void GetSlotFilename(int slot, char *filename, size_t size);
+bool WriteFileAtomic(const char *filename, const void *data, size_t size);
+void InitAutoSaver(AutoSaver *saver);
+void ShutdownAutoSaver(AutoSaver *saver);
+void UpdateAutoSave(AutoSaver *saver, const GameSession *game, const Player *player, SlotIndex *index, float deltaTime);
+void DrawAutoSaveToast(const AutoSaver *saver);
+void *AutoSaveWorker(void *arg);
+void FillSlotInfo(SlotInfo *info, const GameSession *game, const Player *player);
+void PollInput(InputQueue *input);
+void PushInputEvent(InputQueue *input, InputAction action, double time);
+void MarkInputApplied(InputQueue *input, const InputEvent *event);
+void RecordInputLatency(InputQueue *input, double presentTime);
+void DrawInputLatency(const InputQueue *input);
+size_t RewindStateSize(const Map *map);
+size_t RewindDeltaBound(size_t stateSize);
+size_t RewindPoolSize(size_t stateSize);
+void ResetRewind(RewindBuffer *rewind, Arena *arena, const Map *map);
+void ClearRewind(RewindBuffer *rewind);
+size_t ReserveRewindBytes(RewindBuffer *rewind, size_t size);
+void CaptureRewindState(const GameSession *game, const Player *player, unsigned char *out);
+void RestoreRewindState(GameSession *game, Player *player, const unsigned char *in);
+void EncodeXorRle(ByteWriter *w, const unsigned char *a, const unsigned char *b, size_t size);
+void ApplyXorRle(unsigned char *state, const unsigned char *delta, size_t size);
+void RecordRewind(RewindBuffer *rewind, const GameSession *game, const Player *player, Arena *frame);
+bool StepRewind(RewindBuffer *rewind, GameSession *game, Player *player, Arena *frame);
+bool DropOldestRewindGroup(RewindBuffer *rewind);
+bool LoadSlotIndex(SlotIndex *index);
+bool SaveSlotIndex(const SlotIndex *index);
+void RebuildSlotIndex(SlotIndex *index);
+void DrawSlotThumbnail(const SlotInfo *info, int x, int y);
+void DrawBlurredTexture(Texture2D texture, int screenWidth, int screenHeight);
+void CreateGameDirectory(const char *path);
+void InitAssetManager(AssetManager *am);
+void ShutdownAssetManager(AssetManager *am);
+AssetHandle AcquireAsset(AssetManager *am, AssetType type, const char *path);
+void ReleaseAsset(AssetManager *am, AssetHandle handle);
+void UpdateAssets(AssetManager *am, double budget);
+bool AssetsPending(const AssetManager *am);
+void UnloadAssetData(Asset *asset);
+bool IsAssetReady(const AssetManager *am, AssetHandle handle);
+Texture2D GetAssetTexture(const AssetManager *am, AssetHandle handle);
+Sound GetAssetSound(const AssetManager *am, AssetHandle handle);
+void *AssetWorker(void *arg);
+bool OpenPack(Pack *pack, const char *filename);
+void ClosePack(Pack *pack);
+const unsigned char *FindPackEntry(const Pack *pack, const char *name, int *size);
+bool GameFileExists(const char *name);
+int BuildPack(const char *output, char **inputs, int inputCount);
+void InitSoundSystem(SoundSystem *sounds, AssetManager *am);
+void ShutdownSoundSystem(SoundSystem *sounds, AssetManager *am);
+void QueueSound(SoundSystem *sounds, SoundId id);
+void QueueSoundAt(SoundSystem *sounds, SoundId id, int row, int col);
+void UpdateSoundSystem(SoundSystem *sounds, const AssetManager *am);
+void AddPackInput(PackFileList *list, const char *path);
+int ComparePackPaths(const void *a, const void *b);
+
+// Escalas internas selecionáveis (1, 1/2 e 1/4 da resolução da janela)
+static const int renderScales[RENDER_SCALE_COUNT] = {1, 2, 4};
+static int gameRenderScale = 1;
+
+// Pacote de assets mapeado na memória (vazio se o arquivo não existir)
+static Pack gamePack;
+
+// Telemetria local opcional (--telemetria); desligada não cria a thread
+static TelemetryWriter gameTelemetry;
+
+// Fps das cenas ativas (--fps); a simulação anda sempre a SIM_TICK_RATE e o
+// desenho interpola entre os ticks, então mais fps só deixa o movimento mais suave
+static int activeFps = TARGET_FPS;
+
+// Orçamento da IA (--ia-us); medido a cada tick da fase
+static AiBudget aiBudget = { .budgetUs = AI_BUDGET_US, .thinkUs = AI_THINK_COST_US };
+
+// Sempre ligado: gravar um frame no anel custa algumas atribuições
+static FlightRecorder flightRecorder;
+
+// Checksum por tick em log e/ou gravação (--checksums, --gravar)
+static SimRecorder simRecorder;
+
+// Buscas de caminho da simulação (uma por vez, na thread principal)
+static PathSearch pathSearch;
+
+// Mapas já lidos; a fase em andamento mantém uma referência ao seu
+static CachedMap mapCache[MAP_CACHE_SIZE];
+static unsigned mapCacheClock;
+
+// Bytes e blocos vivos por subsistema. Atualizado também pelas threads de
+// autosave, então todo acesso passa pelo lock
+static MemStats memStats[MEM_TAG_COUNT];
+static pthread_mutex_t memStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *memTagNames[MEM_TAG_COUNT] = {
+    [MEM_MAP] = "mapa",
+    [MEM_MONSTERS] = "monstros",
+    [MEM_EFFECTS] = "efeitos",
+    [MEM_REWIND] = "rewind",
+    [MEM_TEXTURES] = "texturas",
+    [MEM_AUDIO] = "audio",
+    [MEM_SAVES] = "saves",
+    [MEM_SCORES] = "placar",
+    [MEM_UI] = "interface",
+    [MEM_PACK] = "pacote",
+    [MEM_ARENAS] = "arenas",
+};
+
+// Orçamentos padrão pensados para os quiosques com pouca RAM; cada linha
+// "nome KB" do MEMORY_BUDGET_FILE substitui o valor do subsistema
+static int64_t memBudgets[MEM_TAG_COUNT] = {
+    [MEM_MAP] = 8 << 20,
+    [MEM_MONSTERS] = 1 << 20,
+    [MEM_EFFECTS] = 1 << 20,
+    [MEM_REWIND] = 16 << 20,
+    [MEM_TEXTURES] = 64 << 20,
+    [MEM_AUDIO] = 32 << 20,
+    [MEM_SAVES] = 4 << 20,
+    [MEM_SCORES] = 16 << 20,
+    [MEM_UI] = 256 << 10,
+    [MEM_PACK] = 128 << 20,
+    [MEM_ARENAS] = 8 << 20,
+};
+
+// Efeitos sem arquivo próprio ainda usam o hover.wav com outro tom
+static const SoundDef soundDefs[SFX_COUNT] = {
+    [SFX_HOVER]         = { "resources/hover.wav", 1.0f, 2, 0 },
+    [SFX_ATTACK]        = { "resources/hover.wav", 0.6f, 4, 1 },
+    [SFX_MONSTER_DEATH] = { "resources/hover.wav", 0.4f, 8, 2 },
+    [SFX_PICKUP]        = { "resources/hover.wav", 1.5f, 2, 2 },
+    [SFX_HURT]          = { "resources/hover.wav", 0.3f, 2, 3 },
+};
+
+// Armas e o alcance de cada uma. A espada mantém a linha de 3 tiles original
+static const AttackDef attackDefs[ATTACK_KIND_COUNT] = {
+    [ATTACK_LINE] = { "ESPADA", 'E', GOLD, {
+        "...#...",
+        "...#...",
+        "...#...",
+        "...@...",
+        ".......",
+        ".......",
+        ".......",
+    } },
+    [ATTACK_ARC] = { "MACHADO", 'A', ORANGE, {
+        ".......",
+        ".......",
+        "..###..",
+        "..#@#..",
+        ".......",
+        ".......",
+        ".......",
+    } },
+    [ATTACK_CONE] = { "CHAMA", 'C', MAROON, {
+        ".#####.",
+        "..###..",
+        "...#...",
+        "...@...",
+        ".......",
+        ".......",
+        ".......",
+    } },
+    [ATTACK_BURST] = { "BOMBA", 'B', PURPLE, {
+        ".......",
+        ".#####.",
+        ".#####.",
+        ".##@##.",
+        ".#####.",
+        ".#####.",
+        ".......",
+    } },
+};
+
+// Preenchida uma vez no início a partir de attackDefs
+static AttackTemplate attackTemplates[ATTACK_KIND_COUNT];
+
+int main(int argc, char **argv) {
+    BuildAttackTemplates();
+
+    // Modo empacotador: ./jogo --pack zinf.pak mapa01.txt mapa02.txt resources
+    if (argc >= 3 && strcmp(argv[1], "--pack") == 0) {
+        return BuildPack(argv[2], &argv[3], argc - 3) ? 0 : 1;
     }
 
-    if (!hoveringAny) {
-        SetMouseCursor(MOUSE_CURSOR_DEFAULT);
-        lastHovered = -1;
+    // Grafos de caminho: ./jogo --hpa mapa01.txt mapa02.txt (grava mapaNN.hpa)
+    if (argc >= 3 && strcmp(argv[1], "--hpa") == 0) {
+        return BuildPathGraphFiles(&argv[2], argc - 2) ? 0 : 1;
+    }
+
+    // Modo verificação: ./jogo --verificar sessao.rec (sem janela)
+    if (argc >= 3 && strcmp(argv[1], "--verificar") == 0) {
+        OpenPack(&gamePack, PACK_FILENAME);
+        bool same = VerifyRecording(argv[2]);
+        ClosePack(&gamePack);
+        return same ? 0 : 1;
     }
-}
 
-int ChooseSaveSlot(const char *prompt) {
-    int selectedSlot = 1;
-    bool choosing = true;
+    bool telemetry = false;
+    float hitchBudget = HITCH_BUDGET_MS;
+    const char *checksumLog = NULL;
+    const char *recordFile = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--telemetria") == 0) telemetry = true;
+        else if (strcmp(argv[i], "--hitch-ms") == 0 && i + 1 < argc) hitchBudget = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--checksums") == 0) checksumLog = CHECKSUM_LOG_FILE;
+        else if (strcmp(argv[i], "--gravar") == 0 && i + 1 < argc) recordFile = argv[++i];
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) activeFps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ia-us") == 0 && i + 1 < argc) aiBudget.budgetUs = atof(argv[++i]);
+    }
 
-    while (choosing && !WindowShouldClose()) {
-        BeginDrawing();
-        ClearBackground(DARKGRAY);
+    const int screenWidth = SCREENWIDTH;
+    const int screenHeight = SCREENHEIGHT;
 
-        DrawText(prompt, (SCREENWIDTH - MeasureText(prompt, 40)) / 2, 150, 40, YELLOW);
+    InitWindow(screenWidth, screenHeight, "ZINF - Trabalho Final");
+    InitAudioDevice();
+    if (activeFps <= 0) activeFps = TARGET_FPS;
+    SetTargetFPS(activeFps);
+    // ESC volta entre telas; o jogo fecha pelo menu ou pela janela
+    SetExitKey(KEY_NULL);
 
-        for (int i = 1; i <= 5; i++) {
-            Color color = (i == selectedSlot) ? RED : WHITE;
-            char slotText[20];
-            snprintf(slotText, sizeof(slotText), "Slot %d", i);
+    // Criar diretórios necessários
+    CreateGameDirectory("saves");
 
-            int x = (SCREENWIDTH - 200) / 2;
-            int y = 200 + i * 60;
-            DrawText(slotText, x, y, 40, color);
-        }
+    static App app = {0};
+    LoadMemoryBudgets(MEMORY_BUDGET_FILE);
+    // Estruturas de tamanho fixo também contam, mesmo sem passar pelo malloc
+    TrackMemory(MEM_MAP, sizeof(mapCache), 1);
+    TrackMemory(MEM_MONSTERS, sizeof(app.game.monsterManager), 1);
+    TrackMemory(MEM_EFFECTS, sizeof(app.game.attackEffect), 1);
+    TrackMemory(MEM_TEXTURES, sizeof(app.assets), 1);
+    TrackMemory(MEM_AUDIO, sizeof(app.sounds), 1);
+    TrackMemory(MEM_SAVES, sizeof(app.autosave) + sizeof(app.slotIndex), 2);
+    TrackMemory(MEM_SCORES, sizeof(app.scores), 1);
+    TrackMemory(MEM_UI, sizeof(app.scenes) + sizeof(app.menu) + sizeof(app.input), 3);
+
+    InitMenu(&app.menu);
+    OpenScoreBoard(&app.scores);
+    if (!LoadSlotIndex(&app.slotIndex)) RebuildSlotIndex(&app.slotIndex);
+
+    // Sem pacote, tudo continua sendo lido dos arquivos soltos
+    OpenPack(&gamePack, PACK_FILENAME);
+
+    // Decodificados em segundo plano; a primeira tela aparece sem esperar
+    InitAssetManager(&app.assets);
+    InitSoundSystem(&app.sounds, &app.assets);
+    InitAutoSaver(&app.autosave);
+    InitTelemetry(&gameTelemetry, telemetry);
+    InitFlightRecorder(&flightRecorder, hitchBudget);
+    OpenSimRecorder(&simRecorder, checksumLog, recordFile);
+    app.background = AcquireAsset(&app.assets, ASSET_TEXTURE, "resources/background.png");
+
+    PushScene(&app, MenuScene());
+
+    // Laço único: toda tela é uma cena, nenhuma função prende o processo
+    while (!WindowShouldClose() && !app.shouldClose && app.sceneCount > 0) {
+        BeginFlightFrame(&flightRecorder, &app);
+        UpdateAssets(&app.assets, ASSET_UPLOAD_BUDGET);
+        MarkFlightPhase(&flightRecorder, PHASE_ASSETS);
+        PollInput(&app.input);
+        if (IsKeyPressed(KEY_F4)) app.showMemory = !app.showMemory;
+        MarkFlightPhase(&flightRecorder, PHASE_INPUT);
+
+        Scene *top = &app.scenes[app.sceneCount - 1];
+        top->update(top, &app);
+        if (app.sceneCount == 0) break;
+        MarkFlightPhase(&flightRecorder, PHASE_UPDATE);
+
+        UpdateSoundSystem(&app.sounds, &app.assets);
+        flightRecorder.current.idle = UpdateFramePacing(&app);
+        MarkFlightPhase(&flightRecorder, PHASE_SOUND);
 
-        DrawText("Use UP/DOWN para mudar, ENTER para confirmar", 300, SCREENHEIGHT - 100, 20, GRAY);
+        BeginDrawing();
+        DrawScenes(&app);
+        MarkFlightPhase(&flightRecorder, PHASE_DRAW);
         EndDrawing();
-
-        if (IsKeyPressed(KEY_DOWN)) selectedSlot = (selectedSlot % 5) + 1;
-        else if (IsKeyPressed(KEY_UP)) selectedSlot = (selectedSlot - 2 + 5) % 5 + 1;
-        else if (IsKeyPressed(KEY_ENTER)) choosing = false;
-        else if (IsKeyPressed(KEY_ESCAPE)) return -1;
+        RecordInputLatency(&app.input, GetTime());
+        MarkFlightPhase(&flightRecorder, PHASE_PRESENT);
     }
 
-    return selectedSlot;
+    // Retrato do uso com tudo ainda carregado, mais os picos da sessão
+    WriteMemoryReport(MEMORY_REPORT_FILE, &app.game);
+
+    ShutdownAutoSaver(&app.autosave);
+    CloseScoreBoard(&app.scores);
+    UnloadLevel(&app.game);
+    ShutdownTelemetry(&gameTelemetry);
+    ShutdownFlightRecorder(&flightRecorder);
+    CloseSimRecorder(&simRecorder);
+    FreeLevelMemory(&app.game);
+    FreeMapCache();
+    ReleaseAsset(&app.assets, app.background);
+    ShutdownSoundSystem(&app.sounds, &app.assets);
+    ShutdownAssetManager(&app.assets);
+    ClosePack(&gamePack);
+    CloseAudioDevice();
+    CloseWindow();
+
+    return 0;
 }
 
-bool LoadGameSlot(Player *player, int slot) {
-    if (slot < 1 || slot > 5) return false;
+void PushScene(App *app, Scene scene) {
+    if (app->sceneCount >= MAX_SCENES) {
+        fprintf(stderr, "Pilha de cenas cheia.\n");
+        return;
+    }
+    app->scenes[app->sceneCount++] = scene;
+    RecordFlightEvent(&flightRecorder, TextFormat("cena +%s", scene.name));
+}
 
-    char filename[64];
-    snprintf(filename, sizeof(filename), "saves/save_slot%d.bin", slot);
+void PopScene(App *app) {
+    if (app->sceneCount == 0) return;
+    app->sceneCount--;
+    RecordFlightEvent(&flightRecorder, TextFormat("cena -%s", app->scenes[app->sceneCount].name));
+}
 
-    FILE *file = fopen(filename, "rb");
-    if (!file) return false;
+void ReplaceScene(App *app, Scene scene) {
+    PopScene(app);
+    PushScene(app, scene);
+}
 
-    bool success = fread(player, sizeof(Player), 1, file) == 1;
-    fclose(file);
-    return success;
+// Volta ao menu principal descartando a fase em andamento
+void PopToMenu(App *app) {
+    UnloadLevel(&app->game);
+    app->sceneCount = 1;
+    RecordFlightEvent(&flightRecorder, "volta ao menu");
 }
 
-void ShowHighScores(const char *filename) {
-    HighScore scores[MAX_SCORES];
-    LoadHighScores(scores, filename);
+void DrawScenes(const App *app) {
+    int first = app->sceneCount - 1;
+    while (first > 0 && app->scenes[first].overlay) first--;
 
-    bool waiting = true;
-    while (waiting && !WindowShouldClose()) {
-        BeginDrawing();
-        ClearBackground(RAYWHITE);
+    for (int i = first; i < app->sceneCount; i++) {
+        app->scenes[i].draw(&app->scenes[i], app);
+    }
+    if (app->input.showLatency) DrawInputLatency(&app->input);
+    if (app->showMemory) DrawMemoryStats(&app->game);
+}
 
-        DrawText("SCOREBOARD - TOP 5", (SCREENWIDTH - MeasureText("SCOREBOARD - TOP 5", 50)) / 2, 100, 50, BLACK);
+// Em cenas idle o EndDrawing() bloqueia até chegar entrada (CPU ~0 parado);
+// sem foco essas telas ainda caem para UNFOCUSED_FPS. O jogo fica sempre
+// em TARGET_FPS fixo
+// Retorna true quando o present pode dormir esperando entrada
+bool UpdateFramePacing(const App *app) {
+    static bool waiting = false;
+    static int fps = TARGET_FPS;
+
+    // Enquanto há assets chegando o laço não pode dormir esperando entrada
+    bool idle = app->scenes[app->sceneCount - 1].idle && !AssetsPending(&app->assets);
+    int targetFps = (idle && !IsWindowFocused()) ? UNFOCUSED_FPS : activeFps;
+
+    if (idle != waiting) {
+        if (idle) EnableEventWaiting();
+        else DisableEventWaiting();
+        waiting = idle;
+    }
 
-        for (int i = 0; i < MAX_SCORES; i++) {
-            char entry[100];
-            snprintf(entry, sizeof(entry), "%d. %-20s %d", i + 1, scores[i].name, scores[i].score);
-            DrawText(entry, (SCREENWIDTH - MeasureText(entry, 30)) / 2, 200 + i * 50, 30, DARKBLUE);
-        }
+    if (targetFps != fps) {
+        SetTargetFPS(targetFps);
+        fps = targetFps;
+    }
+    return idle || targetFps != activeFps;
+}
 
-        DrawText("Pressione ESC para voltar...", 300, SCREENHEIGHT - 100, 20, GRAY);
-        EndDrawing();
+// Carrega a fase atual do jogador; sem arquivo de mapa o jogo terminou
+void StartLevel(App *app) {
+    char mapFile[32];
+    snprintf(mapFile, sizeof(mapFile), "mapa%02d.txt", app->player.level);
 
-        if (IsKeyPressed(KEY_ESCAPE)) waiting = false;
+    if (!GameFileExists(mapFile)) {
+        FinishGame(app);
+        return;
     }
-}
 
-void LoadHighScores(HighScore scores[MAX_SCORES], const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        for (int i = 0; i < MAX_SCORES; i++) {
-            strcpy(scores[i].name, "---");
-            scores[i].score = 0;
-        }
+    if (!LoadLevel(&app->game, mapFile, &app->player)) {
+        PushScene(app, MessageScene("Erro ao carregar a fase!", DARKGRAY, RED, 30, 2.0f, MESSAGE_NONE));
         return;
     }
-    fread(scores, sizeof(HighScore), MAX_SCORES, file);
-    fclose(file);
+    PushScene(app, GameScene());
 }
 
-int CheckHighScorePosition(HighScore scores[MAX_SCORES], int newScore) {
-    for (int i = 0; i < MAX_SCORES; i++) {
-        if (newScore > scores[i].score) return i;
+// Falha (mapa ilegível ou sem memória para as arenas) deixa a sessão
+// inativa e sem mapa
+bool LoadLevel(GameSession *game, const char *mapFile, Player *player) {
+    UnloadLevel(game);
+
+    double loadTime = 0;
+    game->map = AcquireMap(mapFile, &loadTime);
+    if (!game->map) {
+        AbortLevelLoad(game, mapFile);
+        return false;
+    }
+    LocatePlayer(game->map, player);
+
+    // As arenas só crescem quando aparece um mapa maior que os anteriores;
+    // fora isso a fase não faz nenhuma alocação no heap
+    const Map *map = game->map;
+    if (!ReserveArena(&game->levelArena, "fase", LevelArenaSize(map)) ||
+        !ReserveArena(&game->frameArena, "frame", FRAME_ARENA_SIZE + RewindStateSize(map))) {
+        AbortLevelLoad(game, mapFile);
+        return false;
+    }
+
+    memset(game->mapFile, 0, MAP_NAME_LENGTH);
+    strncpy(game->mapFile, mapFile, MAP_NAME_LENGTH - 1);
+    game->itemActive = ArenaAlloc(&game->levelArena, map->itemCount + 1, MEM_MAP);
+    game->deathManager.capacity = map->monsterCount + 1;
+    game->deathManager.deaths = ArenaAlloc(&game->levelArena, sizeof(MonsterDeath) * game->deathManager.capacity, MEM_EFFECTS);
+    game->monsterManager = (MonsterManager){0};
+    game->monsterManager.capacity = map->monsterCount;
+    game->monsterManager.monsters = ArenaAlloc(&game->levelArena, sizeof(Monster) * (map->monsterCount + 1), MEM_MONSTERS);
+    game->monsterManager.cells = ArenaAlloc(&game->levelArena, sizeof(int32_t) * map->rows * map->cols, MEM_MONSTERS);
+    if (!game->itemActive || !game->deathManager.deaths || !game->monsterManager.monsters || !game->monsterManager.cells) {
+        AbortLevelLoad(game, mapFile);
+        return false;
+    }
+
+    memset(game->itemActive, 1, map->itemCount);
+    game->itemHash = HashItemLayer(game);
+    game->rng.state = (uint32_t)GetRandomValue(1, 0x7fffffff);
+
+    game->attackEffect = (AttackEffect){0};
+    game->deathManager.count = 0;
+    game->monsterManager.rows = map->rows;
+    game->monsterManager.cols = map->cols;
+    InitializeMonsters(map, &game->monsterManager);
+    BindProjectileArrays(&game->projectiles, ArenaAlloc(&game->levelArena, ProjectileArraysBytes(PROJECTILE_CAPACITY), MEM_EFFECTS), PROJECTILE_CAPACITY);
+
+    game->frameCount = 0;
+    game->ai = (AiScheduler){0};
+    game->tickAccumulator = 0;
+    game->tickAlpha = 0;
+    game->pendingCount = 0;
+    ResetRewind(&game->rewind, &game->levelArena, map);
+    SetRenderScale(&game->renderer, gameRenderScale);
+    BeginLevelTelemetry(&game->telemetry, game, player, loadTime);
+    BreakSimRecording(&simRecorder);
+    RecordFlightEvent(&flightRecorder, TextFormat("fase %s carregada (%.2f ms)", mapFile, loadTime * 1000.0));
+    game->active = true;
+    return true;
+}
+
+// Desfaz um LoadLevel pela metade: a sessão ainda não está ativa, então o
+// UnloadLevel não serviria
+void AbortLevelLoad(GameSession *game, const char *mapFile) {
+    fprintf(stderr, "Falha ao carregar a fase %s, voltando ao menu.\n", mapFile);
+    RecordFlightEvent(&flightRecorder, TextFormat("fase %s falhou", mapFile));
+    ReleaseMap(game->map);
+    game->map = NULL;
+    game->itemActive = NULL;
+    game->deathManager = (MonsterDeathManager){0};
+    game->monsterManager = (MonsterManager){0};
+    ResetArena(&game->levelArena);
+    ResetArena(&game->frameArena);
+}
+
+// Descarregar é O(1): a memória da fase volta para a arena de uma vez
+void UnloadLevel(GameSession *game) {
+    if (!game->active) return;
+    SubmitLevelTelemetry(&gameTelemetry, &game->telemetry);
+    game->telemetry.active = false;
+    RecordFlightEvent(&flightRecorder, TextFormat("fase %s descarregada", game->mapFile));
+    UnloadLowResRenderer(&game->renderer);
+    ReleaseMap(game->map);
+    game->map = NULL;
+    game->itemActive = NULL;
+    game->deathManager = (MonsterDeathManager){0};
+    game->monsterManager = (MonsterManager){0};
+    game->projectiles = (ProjectilePool){0};
+    game->rewind = (RewindBuffer){0};
+    ResetArena(&game->levelArena);
+    ResetArena(&game->frameArena);
+    game->active = false;
+}
+
+// Soma exata do que LoadLevel e ResetRewind tiram da arena da fase
+size_t LevelArenaSize(const Map *map) {
+    size_t stateSize = RewindStateSize(map);
+    return ArenaAligned(map->itemCount + 1)
+         + ArenaAligned(sizeof(MonsterDeath) * (map->monsterCount + 1))
+         + ArenaAligned(sizeof(Monster) * (map->monsterCount + 1))
+         + ArenaAligned(sizeof(int32_t) * map->rows * map->cols)
+         + ArenaAligned(ProjectileArraysBytes(PROJECTILE_CAPACITY))
+         + ArenaAligned(sizeof(RewindEntry) * REWIND_CAPACITY)
+         + 2 * ArenaAligned(stateSize)
+         + ArenaAligned(RewindPoolSize(stateSize));
+}
+
+void FreeLevelMemory(GameSession *game) {
+    UnloadLevel(game);
+    FreeArena(&game->levelArena);
+    FreeArena(&game->frameArena);
+}
+
+// Garante pelo menos "capacity" bytes. Só pode ser chamada com a arena vazia,
+// já que o buffer pode trocar de lugar
+bool ReserveArena(Arena *arena, const char *name, size_t capacity) {
+    arena->name = name;
+    if (arena->capacity >= capacity) return true;
+
+    unsigned char *base = malloc(capacity);
+    if (!base) {
+        fprintf(stderr, "Sem memoria para a arena %s (%zu bytes)\n", name, capacity);
+        return false;
+    }
+    TrackMemory(MEM_ARENAS, (int64_t)capacity - (int64_t)arena->capacity, arena->base ? 0 : 1);
+    free(arena->base);
+    arena->base = base;
+    arena->capacity = capacity;
+    arena->used = 0;
+    return true;
+}
+
+// Blocos zerados e alinhados em ARENA_ALIGNMENT; NULL quando a arena acaba
+void *ArenaAlloc(Arena *arena, size_t size, MemTag tag) {
+    size_t aligned = ArenaAligned(size);
+    if (aligned > arena->capacity - arena->used) {
+        fprintf(stderr, "Arena %s sem espaco para %zu bytes.\n", arena->name ? arena->name : "?", size);
+        return NULL;
+    }
+    void *block = arena->base + arena->used;
+    arena->used += aligned;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    memset(block, 0, aligned);
+
+    // O espaço passa do livre da arena para o subsistema que pediu
+    arena->tagBytes[tag] += aligned;
+    arena->tagBlocks[tag]++;
+    TrackMemory(tag, (int64_t)aligned, 1);
+    TrackMemory(MEM_ARENAS, -(int64_t)aligned, 0);
+    return block;
+}
+
+void ResetArena(Arena *arena) {
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        if (arena->tagBlocks[tag] == 0) continue;
+        TrackMemory((MemTag)tag, -(int64_t)arena->tagBytes[tag], -arena->tagBlocks[tag]);
+        TrackMemory(MEM_ARENAS, (int64_t)arena->tagBytes[tag], 0);
+        arena->tagBytes[tag] = 0;
+        arena->tagBlocks[tag] = 0;
+    }
+    arena->used = 0;
+}
+
+void FreeArena(Arena *arena) {
+    ResetArena(arena);
+    if (arena->base) TrackMemory(MEM_ARENAS, -(int64_t)arena->capacity, -1);
+    free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+}
+
+size_t ArenaAligned(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+void TrackMemory(MemTag tag, int64_t bytes, int blocks) {
+    pthread_mutex_lock(&memStatsLock);
+    MemStats *stats = &memStats[tag];
+    stats->bytes += bytes;
+    stats->blocks += blocks;
+    if (stats->bytes > stats->peak) stats->peak = stats->bytes;
+
+    // Avisa só na passagem para cima do orçamento, não a cada alocação
+    bool over = memBudgets[tag] > 0 && stats->bytes > memBudgets[tag];
+    if (over && !stats->overBudget) {
+        fprintf(stderr, "Aviso: memoria de %s acima do orcamento (%lld KB de %lld KB)\n", memTagNames[tag],
+                (long long)(stats->bytes >> 10), (long long)(memBudgets[tag] >> 10));
+    }
+    stats->overBudget = over;
+    pthread_mutex_unlock(&memStatsLock);
+}
+
+void GetMemoryStats(MemStats out[MEM_TAG_COUNT]) {
+    pthread_mutex_lock(&memStatsLock);
+    memcpy(out, memStats, sizeof(memStats));
+    pthread_mutex_unlock(&memStatsLock);
+}
+
+void LoadMemoryBudgets(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) return;
+
+    char line[128], name[32];
+    long long kilobytes;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || sscanf(line, "%31s %lld", name, &kilobytes) != 2) continue;
+        int tag = 0;
+        while (tag < MEM_TAG_COUNT && strcmp(memTagNames[tag], name) != 0) tag++;
+        if (tag == MEM_TAG_COUNT) {
+            fprintf(stderr, "Subsistema desconhecido em %s: %s\n", filename, name);
+            continue;
+        }
+        memBudgets[tag] = (int64_t)kilobytes << 10;
+    }
+    fclose(file);
+}
+
+bool WriteMemoryReport(const char *filename, const GameSession *game) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Erro ao gravar o relatorio de memoria %s\n", filename);
+        return false;
+    }
+
+    MemStats stats[MEM_TAG_COUNT];
+    GetMemoryStats(stats);
+    int64_t total = 0, totalPeak = 0;
+    fprintf(file, "%-10s %12s %12s %8s %12s\n", "subsistema", "atual KB", "pico KB", "blocos", "orcamento KB");
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        fprintf(file, "%-10s %12lld %12lld %8d %12lld%s\n", memTagNames[tag], (long long)(stats[tag].bytes >> 10),
+                (long long)(stats[tag].peak >> 10), stats[tag].blocks, (long long)(memBudgets[tag] >> 10),
+                stats[tag].peak > memBudgets[tag] ? "  EXCEDEU" : "");
+        total += stats[tag].bytes;
+        totalPeak += stats[tag].peak;
+    }
+    fprintf(file, "%-10s %12lld %12lld\n\n", "total", (long long)(total >> 10), (long long)(totalPeak >> 10));
+
+    const Arena *arenas[2] = { &game->levelArena, &game->frameArena };
+    for (int i = 0; i < 2; i++) {
+        fprintf(file, "arena %-6s capacidade %zu KB, em uso %zu KB, pico %zu KB\n", arenas[i]->name ? arenas[i]->name : "-",
+                arenas[i]->capacity >> 10, arenas[i]->used >> 10, arenas[i]->peak >> 10);
+    }
+    fclose(file);
+    return true;
+}
+
+// Painel de depuração (F4): uso atual, pico e orçamento de cada subsistema
+void DrawMemoryStats(const GameSession *game) {
+    MemStats stats[MEM_TAG_COUNT];
+    GetMemoryStats(stats);
+
+    int x = SCREENWIDTH - 440, y = 70;
+    DrawRectangle(x - 10, y - 10, 430, 60 + MEM_TAG_COUNT * 22 + 94, Fade(BLACK, 0.75f));
+    DrawText("Memoria (KB)   atual    pico  blocos  orcam.", x, y, 18, RAYWHITE);
+    y += 28;
+
+    int64_t total = 0;
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        Color color = stats[tag].overBudget ? RED : (stats[tag].peak > memBudgets[tag] ? ORANGE : LIGHTGRAY);
+        DrawText(memTagNames[tag], x, y, 18, color);
+        DrawText(TextFormat("%8lld %7lld %7d %7lld", (long long)(stats[tag].bytes >> 10), (long long)(stats[tag].peak >> 10),
+                            stats[tag].blocks, (long long)(memBudgets[tag] >> 10)), x + 120, y, 18, color);
+        total += stats[tag].bytes;
+        y += 22;
+    }
+    DrawText(TextFormat("total %lld KB", (long long)(total >> 10)), x, y + 4, 18, RAYWHITE);
+    DrawText(TextFormat("arena fase %zu/%zu KB  frame pico %zu KB", game->levelArena.used >> 10,
+                        game->levelArena.capacity >> 10, game->frameArena.peak >> 10), x, y + 26, 18, GRAY);
+    DrawText(TextFormat("IA %d pens. %.0f/%.0f us  fila %d", aiBudget.lastThinks, aiBudget.spentUs, aiBudget.budgetUs,
+                        game->ai.backlog / MONSTER_MOVE_INTERVAL), x, y + 48, 18, GRAY);
+    DrawText(TextFormat("IA perto %d  meio %d  longe %d", aiBudget.lodCounts[AI_LOD_NEAR], aiBudget.lodCounts[AI_LOD_MID],
+                        aiBudget.lodCounts[AI_LOD_FAR]), x, y + 70, 18, GRAY);
+}
+
+size_t TextureBytes(Texture2D texture) {
+    if (texture.id == 0) return 0;
+    return (size_t)GetPixelDataSize(texture.width, texture.height, texture.format);
+}
+
+size_t SoundBytes(Sound sound) {
+    return (size_t)sound.frameCount * sound.stream.channels * (sound.stream.sampleSize / 8);
+}
+
+void FinishGame(App *app) {
+    int topPos = GetScoreRank(&app->scores, 0, app->player.score);
+    PushScene(app, VictoryScene(app->player.score, app->player.level, topPos));
+}
+
+Scene MenuScene(void) {
+    return (Scene){ .name = "menu", .update = UpdateMenuScene, .draw = DrawMenuScene, .idle = true };
+}
+
+void UpdateMenuScene(Scene *scene, App *app) {
+    (void)scene;
+    UpdateMenu(&app->menu, SCREENWIDTH, SCREENHEIGHT, &app->sounds, GetFrameTime());
+
+    if (IsKeyPressed(KEY_ENTER)) {
+        switch (app->menu.selected) {
+            case 0:
+                app->player.lives = 3;
+                app->player.score = 0;
+                app->player.level = 1;
+                app->player.playTime = 0;
+                StartLevel(app);
+                break;
+            case 1:
+                PushScene(app, SaveSlotScene(SLOT_LOAD));
+                break;
+            case 2:
+                PushScene(app, HighScoresScene());
+                break;
+            case 3:
+                app->shouldClose = true;
+                break;
+        }
+    }
+}
+
+void DrawMenuScene(const Scene *scene, const App *app) {
+    (void)scene;
+    ClearBackground(BLACK);
+    if (IsAssetReady(&app->assets, app->background)) {
+        DrawBlurredTexture(GetAssetTexture(&app->assets, app->background), SCREENWIDTH, SCREENHEIGHT);
+    } else {
+        // Placeholder até o fundo terminar de carregar
+        DrawRectangle(0, SCREENHEIGHT / 4 - 40, SCREENWIDTH, 160, Fade(DARKGRAY, 0.3f));
+    }
+    DrawMenu(&app->menu, SCREENWIDTH, SCREENHEIGHT);
+}
+
+void CreateGameDirectory(const char *path) {
+    #if defined(_WIN32)
+    _mkdir(path);
+    #else
+    mkdir(path, 0777);
+    #endif
+}
+
+void DrawBlurredTexture(Texture2D texture, int screenWidth, int screenHeight) {
+    Vector2 pos = {0, 0};
+    Rectangle sourceRec = {0, 0, (float)texture.width, (float)-texture.height};
+    Color tint = (Color){255, 255, 255, 30};
+
+    for (int y = -2; y <= 2; y++) {
+        for (int x = -2; x <= 2; x++) {
+            DrawTextureRec(texture, sourceRec, (Vector2){pos.x + x, pos.y + y}, tint);
+        }
+    }
+}
+
+void InitAssetManager(AssetManager *am) {
+    memset(am, 0, sizeof(*am));
+    pthread_mutex_init(&am->lock, NULL);
+    pthread_cond_init(&am->wake, NULL);
+    for (int i = 0; i < ASSET_WORKERS; i++) {
+        pthread_create(&am->workers[i], NULL, AssetWorker, am);
+    }
+}
+
+void ShutdownAssetManager(AssetManager *am) {
+    pthread_mutex_lock(&am->lock);
+    am->quit = true;
+    pthread_cond_broadcast(&am->wake);
+    pthread_mutex_unlock(&am->lock);
+
+    for (int i = 0; i < ASSET_WORKERS; i++) {
+        pthread_join(am->workers[i], NULL);
+    }
+
+    for (int i = 0; i < MAX_ASSETS; i++) {
+        Asset *asset = &am->assets[i];
+        if (asset->state == ASSET_FREE) continue;
+        if (asset->ready) {
+            UnloadAssetData(asset);
+        } else if (asset->state == ASSET_DECODED) {
+            if (asset->type == ASSET_TEXTURE) UnloadImage(asset->image);
+            else UnloadWave(asset->wave);
+        }
+        asset->state = ASSET_FREE;
+    }
+
+    pthread_cond_destroy(&am->wake);
+    pthread_mutex_destroy(&am->lock);
+}
+
+// Devolve o asset já registrado para o mesmo arquivo ou agenda a decodificação
+AssetHandle AcquireAsset(AssetManager *am, AssetType type, const char *path) {
+    int freeSlot = -1;
+    for (int i = 0; i < MAX_ASSETS; i++) {
+        Asset *asset = &am->assets[i];
+        if (asset->state == ASSET_FREE) {
+            if (freeSlot == -1) freeSlot = i;
+        } else if (asset->type == type && strcmp(asset->path, path) == 0) {
+            asset->refCount++;
+            return i + 1;
+        }
+    }
+
+    if (freeSlot == -1) {
+        fprintf(stderr, "Registro de assets cheio: %s\n", path);
+        return 0;
+    }
+
+    Asset *asset = &am->assets[freeSlot];
+    memset(asset, 0, sizeof(*asset));
+    asset->type = type;
+    asset->refCount = 1;
+    strncpy(asset->path, path, ASSET_PATH_LENGTH - 1);
+    am->pending++;
+
+    pthread_mutex_lock(&am->lock);
+    asset->state = ASSET_QUEUED;
+    am->queue[(am->queueHead + am->queueCount) % MAX_ASSETS] = freeSlot;
+    am->queueCount++;
+    pthread_cond_signal(&am->wake);
+    pthread_mutex_unlock(&am->lock);
+
+    return freeSlot + 1;
+}
+
+// Assets ainda em decodificação são descartados quando o worker terminar
+void ReleaseAsset(AssetManager *am, AssetHandle handle) {
+    if (handle <= 0) return;
+    Asset *asset = &am->assets[handle - 1];
+    if (--asset->refCount > 0 || !asset->done) return;
+
+    if (asset->ready) UnloadAssetData(asset);
+
+    pthread_mutex_lock(&am->lock);
+    asset->state = ASSET_FREE;
+    pthread_mutex_unlock(&am->lock);
+}
+
+// Envia para a GPU/dispositivo de áudio o que os workers já decodificaram,
+// parando quando o orçamento do quadro (em segundos) se esgota
+void UpdateAssets(AssetManager *am, double budget) {
+    if (am->pending == 0) return;
+
+    double start = GetTime();
+    for (int i = 0; i < MAX_ASSETS && GetTime() - start < budget; i++) {
+        Asset *asset = &am->assets[i];
+        if (asset->done || asset->state == ASSET_FREE) continue;
+
+        pthread_mutex_lock(&am->lock);
+        AssetState state = asset->state;
+        pthread_mutex_unlock(&am->lock);
+
+        if (state == ASSET_QUEUED) continue;
+
+        if (state == ASSET_DECODED) {
+            if (asset->type == ASSET_TEXTURE) {
+                if (asset->refCount > 0) asset->texture = LoadTextureFromImage(asset->image);
+                UnloadImage(asset->image);
+            } else {
+                if (asset->refCount > 0) asset->sound = LoadSoundFromWave(asset->wave);
+                UnloadWave(asset->wave);
+            }
+            asset->ready = asset->refCount > 0;
+            RecordFlightEvent(&flightRecorder, TextFormat("asset %s enviado", asset->path));
+            if (asset->ready) {
+                if (asset->type == ASSET_TEXTURE) TrackMemory(MEM_TEXTURES, (int64_t)TextureBytes(asset->texture), 1);
+                else TrackMemory(MEM_AUDIO, (int64_t)SoundBytes(asset->sound), 1);
+            }
+        } else {
+            fprintf(stderr, "Erro ao carregar o asset %s\n", asset->path);
+        }
+
+        asset->done = true;
+        am->pending--;
+
+        if (asset->refCount <= 0) {
+            pthread_mutex_lock(&am->lock);
+            asset->state = ASSET_FREE;
+            pthread_mutex_unlock(&am->lock);
+        }
+    }
+}
+
+bool AssetsPending(const AssetManager *am) {
+    return am->pending > 0;
+}
+
+void UnloadAssetData(Asset *asset) {
+    if (asset->type == ASSET_TEXTURE) {
+        TrackMemory(MEM_TEXTURES, -(int64_t)TextureBytes(asset->texture), -1);
+        UnloadTexture(asset->texture);
+    } else {
+        TrackMemory(MEM_AUDIO, -(int64_t)SoundBytes(asset->sound), -1);
+        UnloadSound(asset->sound);
+    }
+}
+
+bool IsAssetReady(const AssetManager *am, AssetHandle handle) {
+    return handle > 0 && am->assets[handle - 1].ready;
+}
+
+Texture2D GetAssetTexture(const AssetManager *am, AssetHandle handle) {
+    if (!IsAssetReady(am, handle)) return (Texture2D){0};
+    return am->assets[handle - 1].texture;
+}
+
+// Um Sound vazio é um placeholder mudo: PlaySound() o ignora
+Sound GetAssetSound(const AssetManager *am, AssetHandle handle) {
+    if (!IsAssetReady(am, handle)) return (Sound){0};
+    return am->assets[handle - 1].sound;
+}
+
+void InitSoundSystem(SoundSystem *sounds, AssetManager *am) {
+    memset(sounds, 0, sizeof(*sounds));
+    for (int i = 0; i < SFX_COUNT; i++) {
+        sounds->pools[i].asset = AcquireAsset(am, ASSET_SOUND, soundDefs[i].path);
+    }
+}
+
+void ShutdownSoundSystem(SoundSystem *sounds, AssetManager *am) {
+    for (int i = 0; i < SFX_COUNT; i++) {
+        SoundPool *pool = &sounds->pools[i];
+        for (int v = 0; v < pool->voiceCount; v++) UnloadSoundAlias(pool->voices[v]);
+        pool->voiceCount = 0;
+        ReleaseAsset(am, pool->asset);
+    }
+}
+
+// Só registra o pedido; nada toca o dispositivo de áudio fora do update
+void QueueSound(SoundSystem *sounds, SoundId id) {
+    if (sounds->eventCount >= MAX_SOUND_EVENTS) return;
+    sounds->events[sounds->eventCount++] = (SoundEvent){ id, false, 0, 0 };
+}
+
+void QueueSoundAt(SoundSystem *sounds, SoundId id, int row, int col) {
+    if (sounds->eventCount >= MAX_SOUND_EVENTS) return;
+    sounds->events[sounds->eventCount++] = (SoundEvent){ id, true, row, col };
+}
+
+// Toca os eventos do quadro: um por tipo de som (o mais próximo), em ordem de
+// prioridade. Cada som rouba a própria voz mais antiga quando o pool está
+// cheio; acima de MAX_ACTIVE_VOICES no total, os de menor prioridade são
+// descartados. A mixagem em si fica na thread de áudio da raylib
+void UpdateSoundSystem(SoundSystem *sounds, const AssetManager *am) {
+    float best[SFX_COUNT];
+    float pan[SFX_COUNT];
+    for (int i = 0; i < SFX_COUNT; i++) best[i] = 0.0f;
+
+    for (int e = 0; e < sounds->eventCount; e++) {
+        const SoundEvent *event = &sounds->events[e];
+        float volume = 1.0f, eventPan = 0.5f;
+
+        if (event->positional) {
+            float dRow = (float)(event->row - sounds->listenerRow);
+            float dCol = (float)(event->col - sounds->listenerCol);
+            float dist = sqrtf(dRow * dRow + dCol * dCol);
+            if (dist >= SOUND_HEARING_TILES) continue;
+            volume = 1.0f - dist / SOUND_HEARING_TILES;
+            eventPan = 0.5f - 0.5f * fmaxf(-1.0f, fminf(1.0f, dCol / SOUND_HEARING_TILES));
+        }
+
+        if (volume > best[event->id]) {
+            best[event->id] = volume;
+            pan[event->id] = eventPan;
+        }
+    }
+    sounds->eventCount = 0;
+
+    int order[SFX_COUNT];
+    int active = 0;
+    for (int i = 0; i < SFX_COUNT; i++) {
+        int j = i;
+        while (j > 0 && soundDefs[order[j - 1]].priority < soundDefs[i].priority) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+
+        for (int v = 0; v < sounds->pools[i].voiceCount; v++) {
+            if (IsSoundPlaying(sounds->pools[i].voices[v])) active++;
+        }
+    }
+
+    for (int k = 0; k < SFX_COUNT; k++) {
+        int i = order[k];
+        SoundPool *pool = &sounds->pools[i];
+        const SoundDef *def = &soundDefs[i];
+
+        // Vozes criadas uma única vez, assim que o som fica pronto
+        if (pool->voiceCount == 0 && IsAssetReady(am, pool->asset)) {
+            Sound source = GetAssetSound(am, pool->asset);
+            for (int v = 0; v < def->maxVoices && v < MAX_VOICES_PER_SOUND; v++) {
+                pool->voices[v] = LoadSoundAlias(source);
+                SetSoundPitch(pool->voices[v], def->pitch);
+            }
+            pool->voiceCount = (def->maxVoices < MAX_VOICES_PER_SOUND) ? def->maxVoices : MAX_VOICES_PER_SOUND;
+        }
+
+        if (best[i] <= 0.0f || pool->voiceCount == 0) continue;
+
+        int voice = -1;
+        for (int v = 0; v < pool->voiceCount; v++) {
+            if (!IsSoundPlaying(pool->voices[v])) {
+                voice = v;
+                break;
+            }
+        }
+
+        if (voice == -1) {
+            voice = pool->nextVoice;
+            StopSound(pool->voices[voice]);
+        } else if (active >= MAX_ACTIVE_VOICES) {
+            continue;
+        } else {
+            active++;
+        }
+        pool->nextVoice = (voice + 1) % pool->voiceCount;
+
+        SetSoundVolume(pool->voices[voice], best[i]);
+        SetSoundPan(pool->voices[voice], pan[i]);
+        PlaySound(pool->voices[voice]);
+    }
+}
+
+// Decodifica arquivos fora da thread principal; nada aqui toca GPU ou áudio
+void *AssetWorker(void *arg) {
+    AssetManager *am = arg;
+
+    pthread_mutex_lock(&am->lock);
+    while (!am->quit) {
+        if (am->queueCount == 0) {
+            pthread_cond_wait(&am->wake, &am->lock);
+            continue;
+        }
+
+        int index = am->queue[am->queueHead];
+        am->queueHead = (am->queueHead + 1) % MAX_ASSETS;
+        am->queueCount--;
+        Asset *asset = &am->assets[index];
+        pthread_mutex_unlock(&am->lock);
+
+        Image image = {0};
+        Wave wave = {0};
+        bool ok;
+        int size = 0;
+        const unsigned char *packed = FindPackEntry(&gamePack, asset->path, &size);
+        const char *ext = GetFileExtension(asset->path);
+
+        if (asset->type == ASSET_TEXTURE) {
+            image = packed ? LoadImageFromMemory(ext, packed, size) : LoadImage(asset->path);
+            ok = image.data != NULL;
+        } else {
+            wave = packed ? LoadWaveFromMemory(ext, packed, size) : LoadWave(asset->path);
+            ok = wave.data != NULL;
+        }
+
+        pthread_mutex_lock(&am->lock);
+        asset->image = image;
+        asset->wave = wave;
+        asset->state = ok ? ASSET_DECODED : ASSET_FAILED;
+    }
+    pthread_mutex_unlock(&am->lock);
+
+    return NULL;
+}
+
+bool OpenPack(Pack *pack, const char *filename) {
+    memset(pack, 0, sizeof(*pack));
+
+#if defined(_WIN32)
+    int size = 0;
+    unsigned char *data = LoadFileData(filename, &size);
+    if (!data) return false;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(PackHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)info.st_size;
+    unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+#endif
+
+    pack->data = data;
+    pack->size = (size_t)size;
+    TrackMemory(MEM_PACK, (int64_t)pack->size, 1);
+
+    // O tamanho vem antes de qualquer leitura do cabeçalho: no Windows o
+    // arquivo não passou pelo teste do fstat
+    const PackHeader *header = (const PackHeader *)data;
+    if ((size_t)size < sizeof(PackHeader) || memcmp(header->magic, PACK_MAGIC, 4) != 0 ||
+        header->version != PACK_VERSION ||
+        header->entryCount > ((size_t)size - sizeof(PackHeader)) / sizeof(PackEntry)) {
+        fprintf(stderr, "Pacote %s invalido, usando arquivos soltos.\n", filename);
+        ClosePack(pack);
+        return false;
+    }
+
+    pack->entries = (const PackEntry *)(data + sizeof(PackHeader));
+    pack->entryCount = (int)header->entryCount;
+    return true;
+}
+
+void ClosePack(Pack *pack) {
+    if (!pack->data) return;
+    TrackMemory(MEM_PACK, -(int64_t)pack->size, -1);
+#if defined(_WIN32)
+    UnloadFileData((unsigned char *)pack->data);
+#else
+    munmap((void *)pack->data, pack->size);
+#endif
+    memset(pack, 0, sizeof(*pack));
+}
+
+// Busca binária no índice (o empacotador grava as entradas ordenadas)
+const unsigned char *FindPackEntry(const Pack *pack, const char *name, int *size) {
+    if (strncmp(name, "./", 2) == 0) name += 2;
+
+    int low = 0, high = pack->entryCount - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        const PackEntry *entry = &pack->entries[mid];
+        int cmp = strncmp(name, entry->name, PACK_NAME_LENGTH);
+        if (cmp == 0) {
+            if (entry->offset > pack->size || entry->size > pack->size - entry->offset || entry->size > INT_MAX) return NULL;
+            *size = (int)entry->size;
+            return pack->data + entry->offset;
+        }
+        if (cmp < 0) high = mid - 1;
+        else low = mid + 1;
+    }
+    return NULL;
+}
+
+bool GameFileExists(const char *name) {
+    int size;
+    if (FindPackEntry(&gamePack, name, &size)) return true;
+
+    FILE *file = fopen(name, "rb");
+    if (!file) return false;
+    fclose(file);
+    return true;
+}
+
+void AddPackInput(PackFileList *list, const char *path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "Ignorando %s (nao encontrado)\n", path);
+        return;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(path);
+        if (!dir) return;
+        struct dirent *item;
+        while ((item = readdir(dir)) != NULL) {
+            if (item->d_name[0] == '.') continue;
+            char child[512];
+            snprintf(child, sizeof(child), "%s/%s", path, item->d_name);
+            AddPackInput(list, child);
+        }
+        closedir(dir);
+        return;
+    }
+
+    if (strncmp(path, "./", 2) == 0) path += 2;
+    if (strlen(path) >= PACK_NAME_LENGTH) {
+        fprintf(stderr, "Ignorando %s (nome longo demais)\n", path);
+        return;
+    }
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->paths = realloc(list->paths, sizeof(char *) * list->capacity);
+    }
+    list->paths[list->count++] = strdup(path);
+}
+
+int ComparePackPaths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Junta mapas, sons, imagens e fontes em um só arquivo indexado
+int BuildPack(const char *output, char **inputs, int inputCount) {
+    PackFileList list = {0};
+    for (int i = 0; i < inputCount; i++) AddPackInput(&list, inputs[i]);
+    if (list.count == 0) {
+        fprintf(stderr, "Nenhum arquivo para empacotar.\n");
+        return 0;
+    }
+    qsort(list.paths, list.count, sizeof(char *), ComparePackPaths);
+
+    FILE *out = fopen(output, "wb");
+    if (!out) {
+        fprintf(stderr, "Erro ao criar o pacote %s\n", output);
+        return 0;
+    }
+
+    PackHeader header = {0};
+    memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = PACK_VERSION;
+    header.entryCount = (uint32_t)list.count;
+
+    PackEntry *entries = calloc(list.count, sizeof(PackEntry));
+    uint64_t offset = sizeof(PackHeader) + sizeof(PackEntry) * (uint64_t)list.count;
+    bool ok = true;
+
+    // O índice é gravado por último, depois de conhecidos os tamanhos
+    fseek(out, (long)offset, SEEK_SET);
+    for (int i = 0; i < list.count && ok; i++) {
+        int size = 0;
+        unsigned char *data = LoadFileData(list.paths[i], &size);
+        if (!data) {
+            ok = false;
+            break;
+        }
+
+        uint64_t aligned = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+        for (; offset < aligned; offset++) fputc(0, out);
+
+        strncpy(entries[i].name, list.paths[i], PACK_NAME_LENGTH - 1);
+        entries[i].offset = offset;
+        entries[i].size = (uint64_t)size;
+        ok = fwrite(data, 1, size, out) == (size_t)size;
+        offset += size;
+        UnloadFileData(data);
+
+        printf("%10d  %s\n", size, list.paths[i]);
+    }
+
+    fseek(out, 0, SEEK_SET);
+    ok = ok && fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(entries, sizeof(PackEntry), list.count, out) == (size_t)list.count;
+    ok = (fclose(out) == 0) && ok;
+
+    if (ok) printf("%d arquivos em %s (%llu bytes)\n", list.count, output, (unsigned long long)offset);
+    else fprintf(stderr, "Erro ao gravar o pacote %s\n", output);
+
+    for (int i = 0; i < list.count; i++) free(list.paths[i]);
+    free(list.paths);
+    free(entries);
+    return ok;
+}
+
+void InitMenu(Menu *menu) {
+    menu->options[0] = "1. Novo Jogo";
+    menu->options[1] = "2. Carregar Jogo";
+    menu->options[2] = "3. Scoreboard";
+    menu->options[3] = "4. Sair";
+    menu->selected = 0;
+    menu->fontSize = 40;
+    menu->spacing = 60;
+}
+
+void DrawMenu(const Menu *menu, int screenWidth, int screenHeight) {
+    const char *title = "ZINF";
+    int baseFontSize = 80;
+    int titleY = screenHeight / 4;
+
+    float scale = 1.0f;
+    int scaledFontSize = (int)(baseFontSize * scale);
+
+    int textWidth = MeasureText(title, scaledFontSize);
+    int textX = (screenWidth - textWidth) / 2;
+
+    DrawText(title, textX, titleY, scaledFontSize, TITLE_COLOR);
+
+    for (int i = 0; i < 4; i++) {
+        int optionWidth = MeasureText(menu->options[i], menu->fontSize);
+        int optionX = (screenWidth - optionWidth) / 2;
+        int optionY = titleY + 150 + i * menu->spacing;
+
+        if (i == menu->selected) {
+            DrawRectangleLines(optionX - 20, optionY - 10, optionWidth + 40, menu->fontSize + 20, RAYWHITE);
+            DrawText(menu->options[i], optionX, optionY, menu->fontSize, RAYWHITE);
+        } else {
+            DrawText(menu->options[i], optionX, optionY, menu->fontSize, MENU_COLOR);
+        }
+    }
+
+    const char *footer = "UFRGS - Algoritmos e Programacao 2025";
+    DrawText(footer, (screenWidth - MeasureText(footer, 20)) / 2, screenHeight - 40, 20, GRAY);
+}
+
+void UpdateMenu(Menu *menu, int screenWidth, int screenHeight, SoundSystem *sounds, float deltaTime) {
+    static int lastHovered = -1;
+    bool hoveringAny = false;
+
+    if (IsKeyPressed(KEY_DOWN)) {
+        menu->selected = (menu->selected + 1) % 4;
+        QueueSound(sounds, SFX_HOVER);
+    } else if (IsKeyPressed(KEY_UP)) {
+        menu->selected = (menu->selected - 1 + 4) % 4;
+        QueueSound(sounds, SFX_HOVER);
+    }
+
+    if (IsKeyPressed(KEY_ONE)) { menu->selected = 0; QueueSound(sounds, SFX_HOVER); }
+    if (IsKeyPressed(KEY_TWO)) { menu->selected = 1; QueueSound(sounds, SFX_HOVER); }
+    if (IsKeyPressed(KEY_THREE)) { menu->selected = 2; QueueSound(sounds, SFX_HOVER); }
+    if (IsKeyPressed(KEY_FOUR)) { menu->selected = 3; QueueSound(sounds, SFX_HOVER); }
+
+    Vector2 mousePos = GetMousePosition();
+    int titleY = screenHeight / 4;
+
+    for (int i = 0; i < 4; i++) {
+        int optionWidth = MeasureText(menu->options[i], menu->fontSize);
+        int optionX = (screenWidth - optionWidth) / 2;
+        int optionY = titleY + 150 + i * menu->spacing;
+
+        Rectangle optionBounds = { (float)optionX, (float)optionY, (float)optionWidth, (float)menu->fontSize };
+
+        if (CheckCollisionPointRec(mousePos, optionBounds)) {
+            hoveringAny = true;
+            SetMouseCursor(MOUSE_CURSOR_POINTING_HAND);
+
+            if (lastHovered != i) {
+                QueueSound(sounds, SFX_HOVER);
+                lastHovered = i;
+            }
+
+            menu->selected = i;
+        }
+    }
+
+    if (!hoveringAny) {
+        SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        lastHovered = -1;
+    }
+}
+
+Scene SaveSlotScene(SlotMode mode) {
+    Scene scene = { .name = "slots", .update = UpdateSaveSlotScene, .draw = DrawSaveSlotScene, .idle = true };
+    scene.state.slot.mode = mode;
+    scene.state.slot.selected = 1;
+    return scene;
+}
+
+void UpdateSaveSlotScene(Scene *scene, App *app) {
+    int *selectedSlot = &scene->state.slot.selected;
+    // O autosave (slot 0) só aparece para carregar
+    int firstSlot = (scene->state.slot.mode == SLOT_LOAD) ? AUTOSAVE_SLOT : 1;
+
+    if (IsKeyPressed(KEY_DOWN)) *selectedSlot = (*selectedSlot < MAX_SAVE_SLOTS) ? *selectedSlot + 1 : firstSlot;
+    else if (IsKeyPressed(KEY_UP)) *selectedSlot = (*selectedSlot > firstSlot) ? *selectedSlot - 1 : MAX_SAVE_SLOTS;
+    else if (IsKeyPressed(KEY_RIGHT)) *selectedSlot = (*selectedSlot + SLOTS_PER_PAGE <= MAX_SAVE_SLOTS) ? *selectedSlot + SLOTS_PER_PAGE : MAX_SAVE_SLOTS;
+    else if (IsKeyPressed(KEY_LEFT)) *selectedSlot = (*selectedSlot - SLOTS_PER_PAGE >= firstSlot) ? *selectedSlot - SLOTS_PER_PAGE : firstSlot;
+    else if (IsKeyPressed(KEY_ESCAPE)) PopScene(app);
+    else if (IsKeyPressed(KEY_ENTER)) {
+        int slot = *selectedSlot;
+        if (scene->state.slot.mode == SLOT_LOAD) {
+            if (!app->slotIndex.slots[slot].used) return;
+            PopScene(app);
+            if (LoadGameSlot(&app->game, &app->player, slot)) PushScene(app, GameScene());
+            else PushScene(app, MessageScene(TextFormat("Erro ao carregar o slot %d!", slot), DARKGRAY, RED, 30, 1.0f, MESSAGE_NONE));
+        } else if (SaveGameSlot(&app->game, &app->player, slot, &app->slotIndex)) {
+            ReplaceScene(app, MessageScene(TextFormat("Jogo salvo no slot %d!", slot), DARKGRAY, GREEN, 30, 1.0f, MESSAGE_NONE));
+        } else {
+            ReplaceScene(app, MessageScene(TextFormat("Erro ao salvar no slot %d!", slot), DARKGRAY, RED, 30, 1.0f, MESSAGE_NONE));
+        }
+    }
+}
+
+void DrawSaveSlotScene(const Scene *scene, const App *app) {
+    const char *prompt = (scene->state.slot.mode == SLOT_LOAD) ?
+        "Escolha um slot para CARREGAR" : "Escolha um slot para SALVAR";
+
+    ClearBackground(DARKGRAY);
+
+    DrawText(prompt, (SCREENWIDTH - MeasureText(prompt, 40)) / 2, 100, 40, YELLOW);
+
+    // Só a página visível é desenhada; tudo vem do índice em memória
+    int firstSlot = (scene->state.slot.mode == SLOT_LOAD) ? AUTOSAVE_SLOT : 1;
+    int page = (scene->state.slot.selected - firstSlot) / SLOTS_PER_PAGE;
+    int pageCount = (MAX_SAVE_SLOTS - firstSlot) / SLOTS_PER_PAGE + 1;
+    int pageStart = firstSlot + page * SLOTS_PER_PAGE;
+
+    for (int i = pageStart; i < pageStart + SLOTS_PER_PAGE && i <= MAX_SAVE_SLOTS; i++) {
+        const SlotInfo *info = &app->slotIndex.slots[i];
+        bool selected = (i == scene->state.slot.selected);
+        Color color = selected ? RED : WHITE;
+        int x = 200;
+        int y = 170 + (i - pageStart) * 120;
+
+        if (selected) DrawRectangle(x - 10, y - 6, SCREENWIDTH - 2 * x + 20, 108, Fade(BLACK, 0.3f));
+        DrawRectangleLines(x, y, THUMB_WIDTH * THUMB_CELL, THUMB_HEIGHT * THUMB_CELL, LIGHTGRAY);
+        if (info->used && info->hasPreview) DrawSlotThumbnail(info, x, y);
+
+        const char *title = (i == AUTOSAVE_SLOT) ? "Autosave" : TextFormat("Slot %d", i);
+        int textX = x + THUMB_WIDTH * THUMB_CELL + 20;
+        DrawText(title, textX, y, 30, color);
+
+        if (!info->used) {
+            DrawText("Vazio", textX, y + 40, 20, GRAY);
+        } else if (!info->hasPreview) {
+            DrawText("Save antigo (sem previa)", textX, y + 40, 20, LIGHTGRAY);
+        } else {
+            DrawText(TextFormat("Fase %d  -  %d pts  -  %d vidas", info->level, info->score, info->lives), textX, y + 38, 20, LIGHTGRAY);
+
+            char date[32] = "";
+            time_t when = (time_t)info->savedAt;
+            struct tm *local = localtime(&when);
+            if (local) strftime(date, sizeof(date), "%d/%m/%Y %H:%M", local);
+            DrawText(TextFormat("%02d:%02d jogados  -  %s", info->playTime / 60, info->playTime % 60, date), textX, y + 64, 20, LIGHTGRAY);
+        }
+    }
+
+    const char *pageText = TextFormat("Pagina %d/%d", page + 1, pageCount);
+    DrawText(pageText, (SCREENWIDTH - MeasureText(pageText, 20)) / 2, SCREENHEIGHT - 140, 20, WHITE);
+    DrawText("UP/DOWN: slot  LEFT/RIGHT: pagina  ENTER: confirmar", 250, SCREENHEIGHT - 100, 20, GRAY);
+}
+
+uint32_t RngNext(GameRng *rng) {
+    uint32_t x = rng->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng->state = x;
+    return x;
+}
+
+uint32_t Crc32(const unsigned char *data, size_t size) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void WriteBytes(ByteWriter *w, const void *data, size_t size) {
+    if (w->size + size > w->capacity) {
+        size_t capacity = w->capacity ? w->capacity : 256;
+        while (capacity < w->size + size) capacity *= 2;
+        w->data = realloc(w->data, capacity);
+        TrackMemory(MEM_SAVES, (int64_t)(capacity - w->capacity), w->capacity ? 0 : 1);
+        w->capacity = capacity;
+    }
+    memcpy(w->data + w->size, data, size);
+    w->size += size;
+}
+
+void FreeByteWriter(ByteWriter *w) {
+    if (w->data) TrackMemory(MEM_SAVES, -(int64_t)w->capacity, -1);
+    free(w->data);
+    w->data = NULL;
+    w->size = w->capacity = 0;
+}
+
+void WriteVarU(ByteWriter *w, uint64_t value) {
+    unsigned char buffer[10];
+    int n = 0;
+    do {
+        buffer[n] = value & 0x7F;
+        value >>= 7;
+        if (value) buffer[n] |= 0x80;
+        n++;
+    } while (value);
+    WriteBytes(w, buffer, n);
+}
+
+void WriteVarI(ByteWriter *w, int64_t value) {
+    WriteVarU(w, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+uint64_t ReadVarU(ByteReader *r) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->pos >= r->size) {
+            r->error = true;
+            return 0;
+        }
+        unsigned char byte = r->data[r->pos++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    r->error = true;
+    return 0;
+}
+
+int64_t ReadVarI(ByteReader *r) {
+    uint64_t value = ReadVarU(r);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+void ReadBytes(ByteReader *r, void *out, size_t size) {
+    if (r->pos + size > r->size) {
+        r->error = true;
+        memset(out, 0, size);
+        return;
+    }
+    memcpy(out, r->data + r->pos, size);
+    r->pos += size;
+}
+
+// Cabeçalho comum dos arquivos binários (saves e índice de pontuações):
+//   magic[4] | u16 versão | u16 reservado | u32 tamanho do payload | u32 CRC32 do payload
+// O escritor reserva SAVE_HEADER_SIZE bytes antes do payload e os preenche aqui
+void SealPayload(ByteWriter *w, const char *magic, int version) {
+    uint32_t payloadSize = (uint32_t)(w->size - SAVE_HEADER_SIZE);
+    uint32_t crc = Crc32(w->data + SAVE_HEADER_SIZE, payloadSize);
+    memcpy(w->data, magic, 4);
+    w->data[4] = version & 0xFF;
+    w->data[5] = (version >> 8) & 0xFF;
+    w->data[6] = w->data[7] = 0;
+    for (int i = 0; i < 4; i++) {
+        w->data[8 + i] = (payloadSize >> (8 * i)) & 0xFF;
+        w->data[12 + i] = (crc >> (8 * i)) & 0xFF;
+    }
+}
+
+bool OpenPayload(const unsigned char *data, size_t size, const char *magic, int version, ByteReader *r) {
+    if (size < SAVE_HEADER_SIZE || memcmp(data, magic, 4) != 0) return false;
+
+    int fileVersion = data[4] | (data[5] << 8);
+    uint32_t payloadSize = 0, crc = 0;
+    for (int i = 0; i < 4; i++) {
+        payloadSize |= (uint32_t)data[8 + i] << (8 * i);
+        crc |= (uint32_t)data[12 + i] << (8 * i);
+    }
+    if (fileVersion != version || payloadSize != size - SAVE_HEADER_SIZE ||
+        Crc32(data + SAVE_HEADER_SIZE, payloadSize) != crc) {
+        return false;
+    }
+
+    *r = (ByteReader){ data + SAVE_HEADER_SIZE, payloadSize, 0, false };
+    return true;
+}
+
+// Save versão 1: cabeçalho "ZSAV" (ver SealPayload)
+//   payload: mapa de origem, Player (com arma, facas e posição do corpo),
+//   contadores da fase, RNG, itens já coletados, monstros (com tipo,
+//   recarga, posição do corpo e deslizamento), efeito de ataque
+//   (arma, origem e direção), animações de morte, tempo de jogo em
+//   milissegundos e os projéteis. Os contadores incluem o cursor e o
+//   acúmulo da fila da IA
+void EncodeGameState(ByteWriter *w, const GameSession *game, const Player *player) {
+    unsigned char header[SAVE_HEADER_SIZE] = {0};
+    WriteBytes(w, header, SAVE_HEADER_SIZE);
+
+    size_t nameLength = strlen(game->mapFile);
+    WriteVarU(w, nameLength);
+    WriteBytes(w, game->mapFile, nameLength);
+
+    WriteVarI(w, player->row);
+    WriteVarI(w, player->col);
+    WriteVarI(w, player->score);
+    WriteVarI(w, player->lives);
+    WriteVarI(w, player->level);
+    WriteVarU(w, (player->swordActive ? 1 : 0) | (player->isBlinking ? 2 : 0));
+    WriteVarI(w, player->blinkFrames);
+    WriteVarI(w, player->facingRow);
+    WriteVarI(w, player->facingCol);
+    WriteVarU(w, player->weapon);
+    WriteVarI(w, player->throwables);
+    WriteVarI(w, player->x);
+    WriteVarI(w, player->y);
+
+    WriteVarU(w, game->frameCount);
+    WriteVarU(w, game->ai.cursor);
+    WriteVarU(w, game->ai.backlog);
+    WriteVarU(w, game->rng.state);
+
+    int itemCount = game->map->itemCount;
+    uint64_t taken = 0;
+    for (int i = 0; i < itemCount; i++) {
+        if (!game->itemActive[i]) taken++;
+    }
+    WriteVarU(w, taken);
+    int last = 0;
+    for (int i = 0; i < itemCount; i++) {
+        if (game->itemActive[i]) continue;
+        WriteVarU(w, i - last);   // índices em delta: poucos bytes por item
+        last = i;
+    }
+
+    const MonsterManager *monsters = &game->monsterManager;
+    WriteVarU(w, monsters->count);
+    for (int i = 0; i < monsters->count; i++) {
+        WriteVarI(w, monsters->monsters[i].row);
+        WriteVarI(w, monsters->monsters[i].col);
+        WriteVarU(w, (monsters->monsters[i].active ? 1 : 0) | (monsters->monsters[i].ranged ? 2 : 0));
+        WriteVarI(w, monsters->monsters[i].cooldown);
+        WriteVarI(w, monsters->monsters[i].x);
+        WriteVarI(w, monsters->monsters[i].y);
+        WriteVarI(w, monsters->monsters[i].vx);
+        WriteVarI(w, monsters->monsters[i].vy);
+        WriteVarU(w, monsters->monsters[i].steps);
+    }
+
+    const AttackEffect *effect = &game->attackEffect;
+    WriteVarU(w, effect->active);
+    WriteVarI(w, effect->frameCounter);
+    WriteVarU(w, effect->kind);
+    WriteVarI(w, effect->row);
+    WriteVarI(w, effect->col);
+    WriteVarU(w, effect->facing);
+
+    const MonsterDeathManager *deaths = &game->deathManager;
+    WriteVarU(w, deaths->count);
+    for (int i = 0; i < deaths->count; i++) {
+        WriteVarI(w, deaths->deaths[i].row);
+        WriteVarI(w, deaths->deaths[i].col);
+        WriteVarI(w, deaths->deaths[i].frameCounter);
+    }
+
+    WriteVarU(w, (uint64_t)(player->playTime * 1000.0f));
+
+    const ProjectilePool *shots = &game->projectiles;
+    WriteVarU(w, shots->count);
+    for (int i = 0; i < shots->count; i++) {
+        WriteVarI(w, shots->x[i]);
+        WriteVarI(w, shots->y[i]);
+        WriteVarI(w, shots->vx[i]);
+        WriteVarI(w, shots->vy[i]);
+        WriteVarU(w, shots->life[i]);
+        WriteVarU(w, shots->owner[i]);
+    }
+
+    SealPayload(w, SAVE_MAGIC, SAVE_VERSION);
+}
+
+// Recarrega o mapa de origem e reaplica o estado salvo por cima, retomando
+// a fase exatamente do ponto em que foi salva
+bool DecodeGameState(const unsigned char *data, size_t size, GameSession *game, Player *player) {
+    ByteReader r;
+    if (!OpenPayload(data, size, SAVE_MAGIC, SAVE_VERSION, &r)) {
+        fprintf(stderr, "Save corrompido ou de versao desconhecida.\n");
+        return false;
+    }
+
+    char mapFile[MAP_NAME_LENGTH] = {0};
+    size_t nameLength = ReadVarU(&r);
+    if (nameLength >= MAP_NAME_LENGTH) return false;
+    ReadBytes(&r, mapFile, nameLength);
+    if (r.error || !GameFileExists(mapFile)) return false;
+
+    Player loaded = {0};
+    loaded.row = (int)ReadVarI(&r);
+    loaded.col = (int)ReadVarI(&r);
+    loaded.score = (int)ReadVarI(&r);
+    loaded.lives = (int)ReadVarI(&r);
+    loaded.level = (int)ReadVarI(&r);
+    uint64_t flags = ReadVarU(&r);
+    loaded.swordActive = flags & 1;
+    loaded.isBlinking = (flags & 2) != 0;
+    loaded.blinkFrames = (int)ReadVarI(&r);
+    loaded.facingRow = (int)ReadVarI(&r);
+    loaded.facingCol = (int)ReadVarI(&r);
+    uint64_t weapon = ReadVarU(&r);
+    if (weapon >= ATTACK_KIND_COUNT) r.error = true;
+    loaded.weapon = r.error ? ATTACK_LINE : (AttackKind)weapon;
+    loaded.throwables = (int)ReadVarI(&r);
+    loaded.x = (int32_t)ReadVarI(&r);
+    loaded.y = (int32_t)ReadVarI(&r);
+    loaded.prevX = loaded.x;
+    loaded.prevY = loaded.y;
+
+    if (!LoadLevel(game, mapFile, player)) return false;
+    *player = loaded;
+
+    game->frameCount = (int)ReadVarU(&r);
+    uint64_t aiCursor = ReadVarU(&r);
+    uint64_t aiBacklog = ReadVarU(&r);
+    game->rng.state = (uint32_t)ReadVarU(&r);
+
+    const Map *map = game->map;
+    uint64_t changed = ReadVarU(&r);
+    size_t index = 0;
+    for (uint64_t i = 0; i < changed && !r.error; i++) {
+        index += ReadVarU(&r);
+        if (index >= (size_t)map->itemCount) r.error = true;
+        else game->itemActive[index] = 0;
+    }
+    if (!SavedCellValid(map, player->row, player->col) || !SavedBodyValid(map, player->x, player->y)) r.error = true;
+
+    MonsterManager *monsters = &game->monsterManager;
+    uint64_t monsterCount = ReadVarU(&r);
+    if (monsterCount > (uint64_t)monsters->capacity) r.error = true;
+    monsters->count = r.error ? 0 : (int)monsterCount;
+    for (int i = 0; i < monsters->count; i++) {
+        monsters->monsters[i].row = (int)ReadVarI(&r);
+        monsters->monsters[i].col = (int)ReadVarI(&r);
+        uint64_t flags = ReadVarU(&r);
+        monsters->monsters[i].active = flags & 1;
+        monsters->monsters[i].ranged = (flags & 2) != 0;
+        monsters->monsters[i].cooldown = (int)ReadVarI(&r);
+        Monster *m = &monsters->monsters[i];
+        m->x = (int32_t)ReadVarI(&r);
+        m->y = (int32_t)ReadVarI(&r);
+        m->vx = (int16_t)ReadVarI(&r);
+        m->vy = (int16_t)ReadVarI(&r);
+        m->steps = (int)ReadVarU(&r);
+        m->prevX = m->x;
+        m->prevY = m->y;
+        if (!SavedCellValid(map, m->row, m->col) || !SavedBodyValid(map, m->x, m->y) ||
+            m->steps < 0 || m->steps > FIXED_ONE / MONSTER_SPEED ||
+            abs(m->vx) > MONSTER_SPEED || abs(m->vy) > MONSTER_SPEED) {
+            r.error = true;
+        }
+    }
+    // A fila só vale dentro do vetor lido e com no máximo uma volta de atraso
+    if (aiCursor > (uint64_t)monsters->count ||
+        aiBacklog > (uint64_t)monsters->count * MONSTER_MOVE_INTERVAL) {
+        r.error = true;
+    }
+    game->ai = r.error ? (AiScheduler){0} : (AiScheduler){ (int)aiCursor, (int)aiBacklog };
+    if (!r.error) RebuildMonsterCells(monsters);
+
+    AttackEffect *effect = &game->attackEffect;
+    effect->active = (int)ReadVarU(&r);
+    effect->frameCounter = (int)ReadVarI(&r);
+    uint64_t kind = ReadVarU(&r);
+    effect->row = (int)ReadVarI(&r);
+    effect->col = (int)ReadVarI(&r);
+    uint64_t facing = ReadVarU(&r);
+    if (kind >= ATTACK_KIND_COUNT || facing >= FACING_COUNT) r.error = true;
+    effect->kind = r.error ? ATTACK_LINE : (AttackKind)kind;
+    effect->facing = r.error ? 0 : (int)facing;
+
+    MonsterDeathManager *deaths = &game->deathManager;
+    uint64_t deathCount = ReadVarU(&r);
+    if (deathCount > (uint64_t)deaths->capacity) r.error = true;
+    deaths->count = r.error ? 0 : (int)deathCount;
+    for (int i = 0; i < deaths->count; i++) {
+        deaths->deaths[i].row = (int)ReadVarI(&r);
+        deaths->deaths[i].col = (int)ReadVarI(&r);
+        deaths->deaths[i].frameCounter = (int)ReadVarI(&r);
+        if (!SavedCellValid(map, deaths->deaths[i].row, deaths->deaths[i].col)) r.error = true;
+    }
+
+    player->playTime = ReadVarU(&r) / 1000.0f;
+
+    ProjectilePool *shots = &game->projectiles;
+    uint64_t shotCount = ReadVarU(&r);
+    if (shotCount > (uint64_t)shots->capacity) r.error = true;
+    shots->count = r.error ? 0 : (int)shotCount;
+    for (int i = 0; i < shots->count; i++) {
+        shots->x[i] = (int32_t)ReadVarI(&r);
+        shots->y[i] = (int32_t)ReadVarI(&r);
+        shots->vx[i] = (int16_t)ReadVarI(&r);
+        shots->vy[i] = (int16_t)ReadVarI(&r);
+        shots->life[i] = (uint16_t)ReadVarU(&r);
+        shots->owner[i] = (uint8_t)ReadVarU(&r);
+        // A varredura só cobre um tile por eixo a cada tick
+        if (!SavedCellValid(map, shots->y[i] >> FIXED_SHIFT, shots->x[i] >> FIXED_SHIFT) ||
+            abs(shots->vx[i]) > FIXED_ONE || abs(shots->vy[i]) > FIXED_ONE || shots->owner[i] > SHOT_PLAYER) {
+            r.error = true;
+        }
+    }
+
+    if (r.error) {
+        fprintf(stderr, "Save truncado ou invalido.\n");
+        UnloadLevel(game);
+        return false;
+    }
+    game->itemHash = HashItemLayer(game);
+    BeginLevelTelemetry(&game->telemetry, game, player, game->telemetry.loadTime);
+    return true;
+}
+
+// Posições lidas do save indexam o mapa direto: fora dele ou fora do chão,
+// o save é rejeitado mesmo com o CRC certo
+bool SavedCellValid(const Map *map, int row, int col) {
+    return row >= 0 && row < map->rows && col >= 0 && col < map->cols && TERRAIN_AT(map, row, col) == ' ';
+}
+
+// Corpo em ponto fixo: basta estar dentro do mapa, já que pode estar no meio
+// do caminho entre duas células
+bool SavedBodyValid(const Map *map, int32_t x, int32_t y) {
+    return x >= 0 && x < (int64_t)map->cols * FIXED_ONE && y >= 0 && y < (int64_t)map->rows * FIXED_ONE;
+}
+
+bool LoadGameSlot(GameSession *game, Player *player, int slot) {
+    if (slot < AUTOSAVE_SLOT || slot > MAX_SAVE_SLOTS) return false;
+
+    char filename[64];
+    GetSlotFilename(slot, filename, sizeof(filename));
+
+    int size = 0;
+    unsigned char *data = LoadFileData(filename, &size);
+    if (!data) return false;
+
+    bool success = DecodeGameState(data, (size_t)size, game, player);
+    UnloadFileData(data);
+    RecordFlightEvent(&flightRecorder, TextFormat("save slot %d %s", slot, success ? "carregado" : "invalido"));
+    return success;
+}
+
+Scene HighScoresScene(void) {
+    Scene scene = { .name = "placar", .update = UpdateHighScoresScene, .draw = DrawHighScoresScene, .idle = true };
+    scene.state.highScores.dirty = true;
+    return scene;
+}
+
+void UpdateHighScoresScene(Scene *scene, App *app) {
+    int *level = &scene->state.highScores.level;
+    int *selected = &scene->state.highScores.selected;
+    bool *dirty = &scene->state.highScores.dirty;
+
+    if (IsKeyPressed(KEY_ESCAPE)) {
+        PopScene(app);
+        return;
+    }
+
+    // Esquerda/direita troca entre o ranking geral e o de cada fase
+    if (IsKeyPressed(KEY_RIGHT)) {
+        *level = (*level + 1) % SCORE_LEVELS;
+        *selected = 0;
+        *dirty = true;
+    } else if (IsKeyPressed(KEY_LEFT)) {
+        *level = (*level + SCORE_LEVELS - 1) % SCORE_LEVELS;
+        *selected = 0;
+        *dirty = true;
+    }
+
+    HighScore scores[SCORE_TOP_N];
+    int count = GetTopScores(&app->scores, *level, scores, SCORE_TOP_N);
+    if (count > 0 && IsKeyPressed(KEY_DOWN)) {
+        *selected = (*selected + 1) % count;
+        *dirty = true;
+    } else if (count > 0 && IsKeyPressed(KEY_UP)) {
+        *selected = (*selected + count - 1) % count;
+        *dirty = true;
+    }
+
+    // O histórico lê o log do disco, então só é buscado quando a seleção muda
+    if (!*dirty) return;
+    *dirty = false;
+    scene->state.highScores.historyCount = 0;
+    memset(&scene->state.highScores.stats, 0, sizeof(PlayerStats));
+    if (*selected >= count) return;
+
+    const PlayerStats *stats = FindPlayerStats(&app->scores, scores[*selected].name);
+    if (stats) scene->state.highScores.stats = *stats;
+    scene->state.highScores.historyCount = GetPlayerHistory(&app->scores, scores[*selected].name,
+                                                            scene->state.highScores.history, SCORE_HISTORY_LENGTH);
+}
+
+void DrawHighScoresScene(const Scene *scene, const App *app) {
+    int level = scene->state.highScores.level;
+    HighScore scores[SCORE_TOP_N];
+    int count = GetTopScores(&app->scores, level, scores, SCORE_TOP_N);
+
+    ClearBackground(RAYWHITE);
+
+    const char *title = (level == 0) ? TextFormat("SCOREBOARD - TOP %d", SCORE_TOP_N)
+                                     : TextFormat("SCOREBOARD - FASE %d", level);
+    DrawText(title, (SCREENWIDTH - MeasureText(title, 50)) / 2, 60, 50, BLACK);
+
+    for (int i = 0; i < SCORE_TOP_N; i++) {
+        char entry[128];
+        if (i < count) snprintf(entry, sizeof(entry), "%d. %-20.20s %d", i + 1, scores[i].name, scores[i].score);
+        else snprintf(entry, sizeof(entry), "%d. %-20.20s %d", i + 1, "---", 0);
+        Color color = (i == scene->state.highScores.selected && i < count) ? RED : DARKBLUE;
+        DrawText(entry, (SCREENWIDTH - MeasureText(entry, 30)) / 2, 140 + i * 45, 30, color);
+    }
+
+    const PlayerStats *stats = &scene->state.highScores.stats;
+    if (stats->games > 0) {
+        const char *summary = TextFormat("%s: recorde %d (fase %d), %d partidas", stats->name, stats->best, stats->bestLevel, stats->games);
+        DrawText(summary, (SCREENWIDTH - MeasureText(summary, 20)) / 2, 610, 20, BLACK);
+
+        for (int i = 0; i < scene->state.highScores.historyCount; i++) {
+            const ScoreRecord *record = &scene->state.highScores.history[i];
+            time_t when = (time_t)record->time;
+            char date[32] = "";
+            struct tm *local = localtime(&when);
+            if (local) strftime(date, sizeof(date), "%d/%m/%Y %H:%M", local);
+            const char *line = TextFormat("%s  -  fase %d  -  %d pts", date, record->level, record->score);
+            DrawText(line, (SCREENWIDTH - MeasureText(line, 20)) / 2, 645 + i * 28, 20, DARKGRAY);
+        }
+    }
+
+    DrawText("Setas: navegar  |  ESC: voltar", 300, SCREENHEIGHT - 80, 20, GRAY);
+}
+
+void LoadHighScores(HighScore scores[MAX_SCORES], const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        for (int i = 0; i < MAX_SCORES; i++) {
+            strcpy(scores[i].name, "---");
+            scores[i].score = 0;
+        }
+        return;
+    }
+    fread(scores, sizeof(HighScore), MAX_SCORES, file);
+    fclose(file);
+}
+
+Scene VictoryScene(int score, int level, int topPosition) {
+    Scene scene = { .name = "vitoria", .update = UpdateVictoryScene, .draw = DrawVictoryScene };
+    scene.state.victory.score = score;
+    scene.state.victory.level = level;
+    scene.state.victory.topPosition = topPosition;
+    return scene;
+}
+
+void UpdateVictoryScene(Scene *scene, App *app) {
+    if (!IsKeyPressed(KEY_ENTER)) return;
+
+    // Toda partida vai para o log (histórico por jogador), não só as do top
+    ReplaceScene(app, NameEntryScene(scene->state.victory.score, scene->state.victory.level,
+                                     scene->state.victory.topPosition));
+}
+
+void DrawVictoryScene(const Scene *scene, const App *app) {
+    (void)app;
+    int topPosition = scene->state.victory.topPosition;
+
+    ClearBackground(BLACK);
+
+    DrawText("Parabens! Todas as fases concluidas!", 300, SCREENHEIGHT / 2, 40, YELLOW);
+    DrawText(TextFormat("Pontuacao final: %d", scene->state.victory.score), 300, SCREENHEIGHT / 2 + 60, 30, WHITE);
+
+    if (topPosition != -1) {
+        char msg[100];
+        snprintf(msg, sizeof(msg), "Com essa pontuacao voce ficou no top %d!", topPosition + 1);
+        DrawText(msg, 300, SCREENHEIGHT / 2 + 120, 30, GREEN);
+    }
+
+    DrawText("Pressione ENTER para continuar...", 300, SCREENHEIGHT / 2 + 200, 20, GRAY);
+}
+
+Scene NameEntryScene(int score, int level, int position) {
+    Scene scene = { .name = "nome", .update = UpdateNameEntryScene, .draw = DrawNameEntryScene };
+    scene.state.nameEntry.score = score;
+    scene.state.nameEntry.level = level;
+    scene.state.nameEntry.position = position;
+    return scene;
+}
+
+void UpdateNameEntryScene(Scene *scene, App *app) {
+    char *name = scene->state.nameEntry.name;
+    int *letterCount = &scene->state.nameEntry.letterCount;
+
+    // Verifica entrada de teclado
+    int key = GetCharPressed();
+    while (key > 0) {
+        if ((key >= 32) && (key <= 125) && (*letterCount < NAME_LENGTH - 1)) {
+            name[*letterCount] = (char)key;
+            name[*letterCount + 1] = '\0';
+            (*letterCount)++;
+        }
+        key = GetCharPressed();
+    }
+
+    if (IsKeyPressed(KEY_BACKSPACE)) {
+        (*letterCount)--;
+        if (*letterCount < 0) *letterCount = 0;
+        name[*letterCount] = '\0';
+    }
+
+    if (IsKeyPressed(KEY_ENTER) && *letterCount > 0) {
+        AddScore(&app->scores, name, scene->state.nameEntry.score, scene->state.nameEntry.level);
+        PopToMenu(app);
+    }
+}
+
+void DrawNameEntryScene(const Scene *scene, const App *app) {
+    (void)app;
+    int pos = scene->state.nameEntry.position;
+
+    ClearBackground(BLACK);
+
+    if (pos != -1) {
+        DrawText("NOVA PONTUACAO ALTA!", (SCREENWIDTH - MeasureText("NOVA PONTUACAO ALTA!", 40)) / 2, 200, 40, YELLOW);
+        DrawText(TextFormat("Posicao: %d", pos + 1), (SCREENWIDTH - MeasureText(TextFormat("Posicao: %d", pos + 1), 30)) / 2, 250, 30, WHITE);
+    } else {
+        DrawText("REGISTRE SUA PONTUACAO", (SCREENWIDTH - MeasureText("REGISTRE SUA PONTUACAO", 40)) / 2, 200, 40, YELLOW);
+    }
+    DrawText("Digite seu nome:", (SCREENWIDTH - MeasureText("Digite seu nome:", 30)) / 2, 300, 30, WHITE);
+
+    // Desenha o retângulo do input
+    Rectangle textBox = { (SCREENWIDTH - 300) / 2, 350, 300, 40 };
+    DrawRectangleRec(textBox, LIGHTGRAY);
+    DrawRectangleLinesEx(textBox, 2, DARKGRAY);
+    DrawText(scene->state.nameEntry.name, textBox.x + 5, textBox.y + 10, 20, MAROON);
+}
+
+// Abre (ou cria) o log, carrega o índice compactado e reprocessa só os
+// registros gravados depois dele. Sem log, importa o ranking antigo de 5 posições
+bool OpenScoreBoard(ScoreBoard *board) {
+    memset(board, 0, sizeof(*board));
+
+    board->log = fopen(SCORE_LOG_FILE, "r+b");
+    if (!board->log) board->log = fopen(SCORE_LOG_FILE, "w+b");
+    if (!board->log) {
+        fprintf(stderr, "Erro ao abrir o log de pontuacoes.\n");
+        return false;
+    }
+
+    SeekFile(board->log, 0, SEEK_END);
+    int64_t logSize = TellFile(board->log);
+    board->recordCount = (logSize > 0) ? logSize / SCORE_RECORD_SIZE : 0;
+
+    if (!LoadScoreIndex(board) || board->indexedCount > board->recordCount) {
+        // Índice ausente, corrompido ou à frente do log: reconstrói do zero
+        FILE *log = board->log;
+        int64_t records = board->recordCount;
+        FreePlayerTable(&board->players);
+        memset(board, 0, sizeof(*board));
+        board->log = log;
+        board->recordCount = records;
+    }
+
+    int replayed = ReplayScoreLog(board, board->indexedCount);
+    if (replayed > 0) SaveScoreIndex(board);
+
+    if (board->recordCount == 0) {
+        HighScore legacy[MAX_SCORES];
+        FILE *file = fopen(SCORE_LEGACY_FILE, "rb");
+        if (file) {
+            fclose(file);
+            LoadHighScores(legacy, SCORE_LEGACY_FILE);
+            for (int i = 0; i < MAX_SCORES; i++) {
+                legacy[i].name[NAME_LENGTH - 1] = '\0';
+                if (legacy[i].score > 0 && legacy[i].name[0] != '\0') AddScore(board, legacy[i].name, legacy[i].score, 0);
+            }
+            SaveScoreIndex(board);
+        }
+    }
+    return true;
+}
+
+void CloseScoreBoard(ScoreBoard *board) {
+    if (!board->log) return;
+    if (board->indexedCount != board->recordCount) SaveScoreIndex(board);
+    fclose(board->log);
+    FreePlayerTable(&board->players);
+    memset(board, 0, sizeof(*board));
+}
+
+// Grava no fim do log e atualiza os heaps e a tabela de jogadores: O(log N)
+// no heap e O(1) amortizado na tabela, independente do tamanho do log
+bool AddScore(ScoreBoard *board, const char *name, int score, int level) {
+    if (!board->log || name[0] == '\0') return false;
+
+    ScoreRecord record = {0};
+    strncpy(record.name, name, NAME_LENGTH - 1);
+    record.time = (int64_t)time(NULL);
+    record.score = score;
+    record.level = level;
+    const PlayerStats *stats = FindPlayerStats(board, record.name);
+    record.previous = stats ? stats->lastRecord : -1;
+    unsigned char packed[SCORE_RECORD_SIZE];
+    PackScoreRecord(&record, packed);
+
+    // Escreve na posição do próximo registro (e não em modo append) para
+    // sobrescrever uma eventual cauda incompleta de uma gravação interrompida
+    if (SeekFile(board->log, board->recordCount * SCORE_RECORD_SIZE, SEEK_SET) != 0 ||
+        fwrite(packed, SCORE_RECORD_SIZE, 1, board->log) != 1 || fflush(board->log) != 0) {
+        fprintf(stderr, "Erro ao salvar o arquivo de pontuacoes.\n");
+        return false;
+    }
+
+    ApplyScoreRecord(board, &record, board->recordCount);
+    board->recordCount++;
+    if (board->recordCount - board->indexedCount >= SCORE_COMPACT_INTERVAL) SaveScoreIndex(board);
+    return true;
+}
+
+void ApplyScoreRecord(ScoreBoard *board, const ScoreRecord *record, int64_t index) {
+    PushTopScore(&board->top[0], record->name, record->score);
+    if (record->level > 0 && record->level < SCORE_LEVELS) {
+        PushTopScore(&board->top[record->level], record->name, record->score);
+    }
+
+    PlayerStats *stats = UpsertPlayer(&board->players, record->name);
+    if (stats->games == 0 || record->score > stats->best) {
+        stats->best = record->score;
+        stats->bestLevel = record->level;
+    }
+    stats->games++;
+    stats->lastRecord = index;
+}
+
+// Lê o log a partir de "first" em blocos; para no primeiro registro
+// inválido, que passa a ser tratado como o fim do log
+int ReplayScoreLog(ScoreBoard *board, int64_t first) {
+    if (first >= board->recordCount) return 0;
+
+    unsigned char *batch = malloc((size_t)SCORE_RECORD_SIZE * SCORE_READ_BATCH);
+    TrackMemory(MEM_SCORES, (int64_t)SCORE_RECORD_SIZE * SCORE_READ_BATCH, 1);
+    SeekFile(board->log, first * SCORE_RECORD_SIZE, SEEK_SET);
+
+    int64_t index = first;
+    while (index < board->recordCount) {
+        size_t wanted = (size_t)(board->recordCount - index);
+        if (wanted > SCORE_READ_BATCH) wanted = SCORE_READ_BATCH;
+        size_t got = fread(batch, SCORE_RECORD_SIZE, wanted, board->log);
+
+        size_t valid = 0;
+        ScoreRecord record;
+        while (valid < got && UnpackScoreRecord(batch + valid * SCORE_RECORD_SIZE, &record)) {
+            ApplyScoreRecord(board, &record, index + (int64_t)valid);
+            valid++;
+        }
+        index += (int64_t)valid;
+        if (valid < wanted) break;
+    }
+
+    free(batch);
+    TrackMemory(MEM_SCORES, -(int64_t)SCORE_RECORD_SIZE * SCORE_READ_BATCH, -1);
+    int replayed = (int)(index - first);
+    board->recordCount = index;
+    return replayed;
+}
+
+void PushTopScore(ScoreHeap *heap, const char *name, int score) {
+    HighScore entry = {0};
+    strncpy(entry.name, name, NAME_LENGTH - 1);
+    entry.score = score;
+
+    int i;
+    if (heap->count < SCORE_TOP_N) {
+        // Sobe a partir da nova folha
+        i = heap->count++;
+        while (i > 0 && heap->entries[(i - 1) / 2].score > score) {
+            heap->entries[i] = heap->entries[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else {
+        // Empate não tira ninguém do top, como no ranking original
+        if (score <= heap->entries[0].score) return;
+        // Substitui a raiz (menor do top) e desce
+        i = 0;
+        while (true) {
+            int child = 2 * i + 1;
+            if (child >= heap->count) break;
+            if (child + 1 < heap->count && heap->entries[child + 1].score < heap->entries[child].score) child++;
+            if (heap->entries[child].score >= score) break;
+            heap->entries[i] = heap->entries[child];
+            i = child;
+        }
+    }
+    heap->entries[i] = entry;
+}
+
+int CompareHighScores(const void *a, const void *b) {
+    const HighScore *sa = a, *sb = b;
+    return (sb->score > sa->score) - (sb->score < sa->score);
+}
+
+// Copia o heap já limitado a SCORE_TOP_N e ordena: custo fixo, sem tocar o disco
+int GetTopScores(const ScoreBoard *board, int level, HighScore *out, int max) {
+    if (level < 0 || level >= SCORE_LEVELS) return 0;
+    const ScoreHeap *heap = &board->top[level];
+    int count = heap->count < max ? heap->count : max;
+
+    HighScore sorted[SCORE_TOP_N];
+    memcpy(sorted, heap->entries, sizeof(HighScore) * heap->count);
+    qsort(sorted, heap->count, sizeof(HighScore), CompareHighScores);
+    memcpy(out, sorted, sizeof(HighScore) * count);
+    return count;
+}
+
+// Posição que a pontuação ocuparia no top (-1 se não entrar)
+int GetScoreRank(const ScoreBoard *board, int level, int score) {
+    if (level < 0 || level >= SCORE_LEVELS) return -1;
+    const ScoreHeap *heap = &board->top[level];
+    int rank = 0;
+    for (int i = 0; i < heap->count; i++) {
+        if (heap->entries[i].score >= score) rank++;
+    }
+    return rank < SCORE_TOP_N ? rank : -1;
+}
+
+PlayerStats *FindPlayerSlot(const PlayerTable *table, const char *name) {
+    uint32_t hash = 2166136261u;   // FNV-1a
+    for (const char *c = name; *c; c++) hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+    int mask = table->capacity - 1;
+    for (int i = hash & mask;; i = (i + 1) & mask) {
+        PlayerStats *slot = &table->slots[i];
+        if (slot->name[0] == '\0' || strcmp(slot->name, name) == 0) return slot;
+    }
+}
+
+PlayerStats *UpsertPlayer(PlayerTable *table, const char *name) {
+    // Mantém a ocupação abaixo de 70% para as sondagens ficarem curtas
+    if ((table->count + 1) * 10 >= table->capacity * 7) {
+        PlayerTable grown = { calloc(table->capacity ? table->capacity * 2 : 64, sizeof(PlayerStats)),
+                              table->capacity ? table->capacity * 2 : 64, table->count };
+        for (int i = 0; i < table->capacity; i++) {
+            if (table->slots[i].name[0] != '\0') *FindPlayerSlot(&grown, table->slots[i].name) = table->slots[i];
+        }
+        FreePlayerTable(table);
+        TrackMemory(MEM_SCORES, (int64_t)(sizeof(PlayerStats) * grown.capacity), 1);
+        *table = grown;
+    }
+
+    PlayerStats *slot = FindPlayerSlot(table, name);
+    if (slot->name[0] == '\0') {
+        strncpy(slot->name, name, NAME_LENGTH - 1);
+        slot->lastRecord = -1;
+        table->count++;
+    }
+    return slot;
+}
+
+void FreePlayerTable(PlayerTable *table) {
+    if (table->slots) TrackMemory(MEM_SCORES, -(int64_t)(sizeof(PlayerStats) * table->capacity), -1);
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = table->count = 0;
+}
+
+const PlayerStats *FindPlayerStats(const ScoreBoard *board, const char *name) {
+    if (board->players.capacity == 0 || name[0] == '\0') return NULL;
+    const PlayerStats *slot = FindPlayerSlot(&board->players, name);
+    return slot->name[0] != '\0' ? slot : NULL;
+}
+
+// Segue a cadeia "previous" a partir da última partida: lê só os registros
+// do jogador, da mais recente para a mais antiga
+int GetPlayerHistory(const ScoreBoard *board, const char *name, ScoreRecord *out, int max) {
+    const PlayerStats *stats = FindPlayerStats(board, name);
+    if (!stats || !board->log) return 0;
+
+    int count = 0;
+    int64_t index = stats->lastRecord;
+    while (count < max && index >= 0 && index < board->recordCount) {
+        ScoreRecord *record = &out[count];
+        unsigned char packed[SCORE_RECORD_SIZE];
+        if (SeekFile(board->log, index * SCORE_RECORD_SIZE, SEEK_SET) != 0 ||
+            fread(packed, SCORE_RECORD_SIZE, 1, board->log) != 1 ||
+            !UnpackScoreRecord(packed, record) || record->previous >= index) {
+            break;
+        }
+        index = record->previous;
+        count++;
+    }
+    return count;
+}
+
+// Campo a campo em little-endian, com o nome inteiro e o CRC32 dos bytes
+// anteriores no fim: o log não depende de padding nem da ordem dos bytes
+void PackScoreRecord(const ScoreRecord *record, unsigned char *out) {
+    PutLittleEndian(out, (uint64_t)record->time, 8);
+    PutLittleEndian(out + 8, (uint64_t)record->previous, 8);
+    PutLittleEndian(out + 16, (uint32_t)record->score, 4);
+    PutLittleEndian(out + 20, (uint32_t)record->level, 4);
+    memcpy(out + 24, record->name, NAME_LENGTH);
+    PutLittleEndian(out + 24 + NAME_LENGTH, Crc32(out, 24 + NAME_LENGTH), 4);
+}
+
+// false se o CRC não bate: registro cortado por uma gravação interrompida
+bool UnpackScoreRecord(const unsigned char *in, ScoreRecord *record) {
+    if (GetLittleEndian(in + 24 + NAME_LENGTH, 4) != Crc32(in, 24 + NAME_LENGTH)) return false;
+    record->time = (int64_t)GetLittleEndian(in, 8);
+    record->previous = (int64_t)GetLittleEndian(in + 8, 8);
+    record->score = (int32_t)GetLittleEndian(in + 16, 4);
+    record->level = (int32_t)GetLittleEndian(in + 20, 4);
+    memcpy(record->name, in + 24, NAME_LENGTH);
+    record->name[NAME_LENGTH - 1] = '\0';
+    return true;
+}
+
+void PutLittleEndian(unsigned char *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+uint64_t GetLittleEndian(const unsigned char *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+// Índice versão 1: cabeçalho "ZIDX" (ver SealPayload)
+//   payload: registros cobertos | por fase: quantidade e (nome, pontuação) do heap |
+//            jogadores: (nome, recorde, fase do recorde, partidas, último registro)
+bool SaveScoreIndex(ScoreBoard *board) {
+    ByteWriter writer = {0};
+    unsigned char header[SAVE_HEADER_SIZE] = {0};
+    WriteBytes(&writer, header, SAVE_HEADER_SIZE);
+
+    WriteVarU(&writer, (uint64_t)board->recordCount);
+    for (int level = 0; level < SCORE_LEVELS; level++) {
+        const ScoreHeap *heap = &board->top[level];
+        WriteVarU(&writer, heap->count);
+        for (int i = 0; i < heap->count; i++) {
+            size_t length = strlen(heap->entries[i].name);
+            WriteVarU(&writer, length);
+            WriteBytes(&writer, heap->entries[i].name, length);
+            WriteVarI(&writer, heap->entries[i].score);
+        }
+    }
+
+    WriteVarU(&writer, board->players.count);
+    for (int i = 0; i < board->players.capacity; i++) {
+        const PlayerStats *stats = &board->players.slots[i];
+        if (stats->name[0] == '\0') continue;
+        size_t length = strlen(stats->name);
+        WriteVarU(&writer, length);
+        WriteBytes(&writer, stats->name, length);
+        WriteVarI(&writer, stats->best);
+        WriteVarI(&writer, stats->bestLevel);
+        WriteVarU(&writer, stats->games);
+        WriteVarI(&writer, stats->lastRecord);
+    }
+
+    SealPayload(&writer, SCORE_INDEX_MAGIC, SCORE_INDEX_VERSION);
+    bool success = WriteFileAtomic(SCORE_INDEX_FILE, writer.data, writer.size);
+    FreeByteWriter(&writer);
+
+    if (success) board->indexedCount = board->recordCount;
+    else fprintf(stderr, "Erro ao salvar o indice de pontuacoes.\n");
+    return success;
+}
+
+bool LoadScoreIndex(ScoreBoard *board) {
+    int size = 0;
+    unsigned char *data = LoadFileData(SCORE_INDEX_FILE, &size);
+    if (!data) return false;
+
+    ByteReader r;
+    if (!OpenPayload(data, (size_t)size, SCORE_INDEX_MAGIC, SCORE_INDEX_VERSION, &r)) {
+        UnloadFileData(data);
+        return false;
+    }
+
+    board->indexedCount = (int64_t)ReadVarU(&r);
+    for (int level = 0; level < SCORE_LEVELS && !r.error; level++) {
+        ScoreHeap *heap = &board->top[level];
+        uint64_t count = ReadVarU(&r);
+        if (count > SCORE_TOP_N) r.error = true;
+        for (uint64_t i = 0; i < count && !r.error; i++) {
+            char name[NAME_LENGTH] = {0};
+            size_t length = ReadVarU(&r);
+            if (length >= NAME_LENGTH) {
+                r.error = true;
+                break;
+            }
+            ReadBytes(&r, name, length);
+            PushTopScore(heap, name, (int)ReadVarI(&r));
+        }
+    }
+
+    uint64_t players = ReadVarU(&r);
+    for (uint64_t i = 0; i < players && !r.error; i++) {
+        char name[NAME_LENGTH] = {0};
+        size_t length = ReadVarU(&r);
+        if (length == 0 || length >= NAME_LENGTH) {
+            r.error = true;
+            break;
+        }
+        ReadBytes(&r, name, length);
+        PlayerStats *stats = UpsertPlayer(&board->players, name);
+        stats->best = (int)ReadVarI(&r);
+        stats->bestLevel = (int)ReadVarI(&r);
+        stats->games = (int)ReadVarU(&r);
+        stats->lastRecord = ReadVarI(&r);
+    }
+
+    UnloadFileData(data);
+    return !r.error;
+}
+
+Scene GameScene(void) {
+    return (Scene){ .name = "jogo", .update = UpdateGameScene, .draw = DrawGameScene };
+}
+
+void UpdateGameScene(Scene *scene, App *app) {
+    (void)scene;
+    GameSession *game = &app->game;
+    Player *player = &app->player;
+
+    // Segurar R volta um tick por frame; a simulação fica parada enquanto isso
+    ResetArena(&game->frameArena);
+    RecordFrameTelemetry(&game->telemetry, GetFrameTime());
+    game->rewind.rewinding = IsKeyDown(KEY_R) && StepRewind(&game->rewind, game, player, &game->frameArena);
+    if (game->rewind.rewinding) {
+        BreakSimRecording(&simRecorder);
+        game->tickAccumulator = 0;
+        game->tickAlpha = 1.0f;
+        return;
+    }
+
+    player->playTime += GetFrameTime();
+
+    if (IsKeyPressed(KEY_F2)) CycleRenderScale(&game->renderer);
+
+    app->sounds.listenerRow = player->row;
+    app->sounds.listenerCol = player->col;
+
+    // As teclas do frame esperam o próximo tick; pausa e saída são da cena e
+    // valem depois dos ticks do frame, com a simulação já consistente
+    const InputEvent *sceneEvent = NULL;
+    for (int i = 0; i < app->input.count; i++) {
+        const InputEvent *event = &app->input.events[i];
+        if (event->action == INPUT_PAUSE || event->action == INPUT_EXIT) {
+            sceneEvent = event;
+            break;
+        }
+        if (game->pendingCount < MAX_PENDING_ACTIONS) game->pendingEvents[game->pendingCount++] = *event;
+    }
+
+    // Passo fixo: SIM_TICK_RATE ticks por segundo qualquer que seja o fps,
+    // então o movimento não depende da máquina e a simulação segue
+    // determinística. Frames lentos rodam até MAX_TICKS_PER_FRAME ticks e o
+    // atraso além disso é descartado
+    game->tickAccumulator += GetFrameTime();
+    aiBudget.spentUs = 0;
+    int ticks = 0;
+    while (game->tickAccumulator >= SIM_DT && ticks < MAX_TICKS_PER_FRAME) {
+        game->tickAccumulator -= SIM_DT;
+        InputAction actions[MAX_INPUT_EVENTS];
+        // A latência conta a partir do tick que de fato consome a tecla
+        int actionCount = 0;
+        for (int i = 0; i < game->pendingCount; i++) {
+            MarkInputApplied(&app->input, &game->pendingEvents[i]);
+            actions[actionCount++] = game->pendingEvents[i].action;
+        }
+        game->pendingCount = 0;
+        for (int dir = 0; dir <= INPUT_MOVE_RIGHT; dir++) {
+            if (app->input.held[dir]) actions[actionCount++] = (InputAction)dir;
+        }
+        if (!RunGameTick(app, actions, actionCount)) return;
+        ticks++;
+    }
+    if (ticks == MAX_TICKS_PER_FRAME && game->tickAccumulator >= SIM_DT) game->tickAccumulator = 0;
+    game->tickAlpha = game->tickAccumulator / SIM_DT;
+
+    UpdateAutoSave(&app->autosave, game, player, &app->slotIndex, GetFrameTime());
+
+    if (!sceneEvent) return;
+    MarkInputApplied(&app->input, sceneEvent);
+    if (sceneEvent->action == INPUT_PAUSE) PushScene(app, PauseScene());
+    else PopToMenu(app);
+}
+
+// Um tick com gravação, telemetria e rewind em volta da simulação. Retorna
+// false se a fase terminou (a cena já foi trocada)
+bool RunGameTick(App *app, const InputAction *actions, int actionCount) {
+    GameSession *game = &app->game;
+    Player *player = &app->player;
+
+    ResetArena(&game->frameArena);
+    BeginSimTick(&simRecorder, game, player);
+    int aiLimit = AiThinkLimit(&aiBudget);
+    StepSimulation(game, player, actions, actionCount, aiLimit, &app->sounds);
+    AccountAiTick(&aiBudget);
+    // O checksum percorre o estado inteiro: só sai quando há log ou gravação
+    if (simRecorder.log || simRecorder.file) {
+        RecordSimTick(&simRecorder, game, player, actions, actionCount, aiLimit, SimulationChecksum(game, player));
+    }
+    UpdateLevelTelemetry(&game->telemetry, game, player);
+
+    if (CountActiveMonsters(&game->monsterManager) == 0) {
+        game->telemetry.completed = true;
+        UnloadLevel(game);
+        ReplaceScene(app, MessageScene("Fase concluida!", RAYWHITE, GREEN, 60, 2.0f, MESSAGE_NEXT_LEVEL));
+        return false;
+    }
+
+    // Fim do tick: estado consistente para o rewind e o snapshot do autosave
+    RecordRewind(&game->rewind, game, player, &game->frameArena);
+    return true;
+}
+
+// Um tick da simulação, só com o estado da fase e as ações do jogador: sem
+// relógio, tela ou teclado, então a mesma entrada sempre dá o mesmo estado.
+// As direções nas ações são as seguradas no tick; várias iguais valem uma.
+// aiLimit é o máximo de pensamentos de monstro no tick
+void StepSimulation(GameSession *game, Player *player, const InputAction *actions, int actionCount, int aiLimit, SoundSystem *sounds) {
+    game->frameCount++;
+    player->prevX = player->x;
+    player->prevY = player->y;
+
+    int killed = 0;
+    bool held[INPUT_MOVE_RIGHT + 1] = {false};
+    for (int i = 0; i < actionCount; i++) {
+        switch (actions[i]) {
+            case INPUT_MOVE_UP:
+            case INPUT_MOVE_DOWN:
+            case INPUT_MOVE_LEFT:
+            case INPUT_MOVE_RIGHT:
+                held[actions[i]] = true;
+                break;
+            case INPUT_ATTACK:
+                killed += PerformAttack(player, &game->attackEffect, &game->deathManager, &game->monsterManager, sounds);
+                break;
+            case INPUT_THROW: ThrowItem(game, player, sounds); break;
+            default: break;
+        }
+    }
+    int dirRow = held[INPUT_MOVE_DOWN] - held[INPUT_MOVE_UP];
+    int dirCol = held[INPUT_MOVE_RIGHT] - held[INPUT_MOVE_LEFT];
+    UpdatePlayer(game, player, dirRow, dirCol, sounds);
+
+    // A busca de caminhos de um tick não passa para o seguinte: a escolha
+    // entre caminhos empatados depende dela, e só o estado salvo é replicado
+    pathSearch.graph = NULL;
+    RunAiScheduler(game, player, aiLimit, sounds);
+    MoveMonsters(game->map, &game->monsterManager);
+    FireRangedMonsters(game, player, sounds);
+    killed += UpdateProjectiles(game, player, sounds);
+    // Monstros mortos no tick só saem do vetor agora, numa passada
+    if (killed > 0) CompactMonsters(&game->monsterManager, &game->ai);
+
+    if (game->attackEffect.active && --game->attackEffect.frameCounter <= 0) game->attackEffect.active = 0;
+    UpdateMonsterDeaths(&game->deathManager);
+    if (player->isBlinking && --player->blinkFrames <= 0) player->isBlinking = false;
+}
+
+void DrawGameScene(const Scene *scene, const App *app) {
+    (void)scene;
+    const GameSession *game = &app->game;
+    const Player *player = &app->player;
+    const LowResRenderer *renderer = &game->renderer;
+
+    Vector2 focus = InterpolateBody(player->prevX, player->prevY, player->x, player->y, game->tickAlpha);
+    Camera2D camera = UpdateGameCamera(game->map, focus, renderer->scale);
+
+    if (renderer->scale > 1) {
+        BeginTextureMode(renderer->target);
+        ClearBackground(RAYWHITE);
+        DrawWorld(game, player, camera);
+        EndTextureMode();
+    }
+
+    ClearBackground(RAYWHITE);
+
+    if (renderer->scale > 1) {
+        // Ampliação inteira com filtro de ponto: mantém o visual pixelado
+        Texture2D lowRes = renderer->target.texture;
+        Rectangle source = {0, 0, (float)lowRes.width, (float)-lowRes.height};
+        Rectangle dest = {0, HUD_HEIGHT, (float)lowRes.width * renderer->scale, (float)lowRes.height * renderer->scale};
+        DrawTexturePro(lowRes, source, dest, (Vector2){0, 0}, 0.0f, WHITE);
+    } else {
+        DrawWorld(game, player, camera);
+    }
+
+    DrawHUD(player, renderer->scale);
+    DrawAutoSaveToast(&app->autosave);
+    if (game->rewind.rewinding) {
+        const RewindBuffer *rewind = &game->rewind;
+        DrawText(TextFormat("<< REWIND  %.1fs  (%d KB)", rewind->count / (float)SIM_TICK_RATE, (int)(rewind->bytesUsed / 1024)),
+                 20, HUD_HEIGHT + 15, 20, MAROON);
+    }
+    DrawText("WASD para mover | J para atacar | K para arremessar | R para voltar | TAB para pausar | ESC para sair", 360, SCREENHEIGHT-30, 20, DARKGRAY);
+}
+
+void DrawWorld(const GameSession *game, const Player *player, Camera2D camera) {
+    const AttackEffect *effect = &game->attackEffect;
+    TileRange view = GetVisibleTiles(camera, game->map);
+
+    BeginMode2D(camera);
+    DrawMap(game, player, view);
+
+    if (effect->active) {
+        const AttackTemplate *attack = &attackTemplates[effect->kind];
+        Color color = Fade(attackDefs[effect->kind].color, 0.5f);
+        for (int i = 0; i < attack->offsetCount; i++) {
+            int ty = effect->row + attack->offsets[effect->facing][i][0];
+            int tx = effect->col + attack->offsets[effect->facing][i][1];
+            if (tx >= view.firstCol && tx <= view.lastCol && ty >= view.firstRow && ty <= view.lastRow) {
+                Rectangle area = {tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE};
+                DrawRectangleRec(area, color);
+            }
+        }
+    }
+
+    DrawProjectiles(&game->projectiles, view);
+    DrawMonsterDeaths(&game->deathManager, view);
+    EndMode2D();
+}
+
+void SetRenderScale(LowResRenderer *renderer, int scale) {
+    UnloadLowResRenderer(renderer);
+    renderer->scale = scale;
+    if (scale > 1) {
+        renderer->target = LoadRenderTexture(VIEW_WIDTH / scale, VIEW_HEIGHT / scale);
+        SetTextureFilter(renderer->target.texture, TEXTURE_FILTER_POINT);
+        // Cor mais o buffer de profundidade, que tem o mesmo tamanho
+        TrackMemory(MEM_TEXTURES, 2 * (int64_t)TextureBytes(renderer->target.texture), 1);
+    }
+}
+
+void CycleRenderScale(LowResRenderer *renderer) {
+    int next = 0;
+    for (int i = 0; i < RENDER_SCALE_COUNT; i++) {
+        if (renderScales[i] == renderer->scale) next = (i + 1) % RENDER_SCALE_COUNT;
+    }
+    gameRenderScale = renderScales[next];
+    SetRenderScale(renderer, gameRenderScale);
+}
+
+void UnloadLowResRenderer(LowResRenderer *renderer) {
+    if (renderer->target.id > 0) {
+        TrackMemory(MEM_TEXTURES, -2 * (int64_t)TextureBytes(renderer->target.texture), -1);
+        UnloadRenderTexture(renderer->target);
+    }
+    renderer->target = (RenderTexture2D){0};
+    renderer->scale = 1;
+}
+
+// Falha (arquivo ausente ou sem memória) deixa o mapa zerado
+bool LoadMapFromFile(Map *map, const char *filename) {
+    int packedSize = 0;
+    const char *text = (const char *)FindPackEntry(&gamePack, filename, &packedSize);
+    long size = packedSize;
+    char *fileText = NULL;
+
+    if (!text) {
+        FILE *file = fopen(filename, "rb");
+        if (!file) {
+            fprintf(stderr, "Erro ao abrir o arquivo %s\n", filename);
+            return false;
+        }
+
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        fileText = malloc(size + 1);
+        if (!fileText || fread(fileText, 1, size, file) != (size_t)size) {
+            fprintf(stderr, "Erro ao ler o arquivo %s\n", filename);
+            free(fileText);
+            fclose(file);
+            return false;
+        }
+        fclose(file);
+        text = fileText;
+    }
+
+    // Primeira passada: dimensões (a maior linha define a largura)
+    int rows = 0, cols = 0, len = 0;
+    for (long i = 0; i <= size; i++) {
+        char ch = (i < size) ? text[i] : '\n';
+        if (ch == '\n') {
+            if (len > 0) {
+                rows++;
+                if (len > cols) cols = len;
+            }
+            len = 0;
+        } else if (ch != '\r') {
+            len++;
+        }
+    }
+    if (rows > MAX_MAP_ROWS) rows = MAX_MAP_ROWS;
+    if (cols > MAX_MAP_COLS) cols = MAX_MAP_COLS;
+
+    memset(map, 0, sizeof(*map));
+    strncpy(map->name, filename, MAP_NAME_LENGTH - 1);
+    map->rows = rows;
+    map->cols = cols;
+    map->terrain = malloc((size_t)rows * cols);
+    if (!map->terrain) {
+        fprintf(stderr, "Erro ao alocar o mapa %s\n", filename);
+        free(fileText);
+        return false;
+    }
+    memset(map->terrain, ' ', (size_t)rows * cols);
+
+    // Segunda passada: copia as linhas (linhas curtas ficam completadas com
+    // chão) separando as entidades do terreno. A ordem de leitura já deixa os
+    // itens ordenados por célula
+    int itemCapacity = 0, monsterCapacity = 0;
+    bool foundPlayer = false;
+    int row = 0, col = 0;
+    for (long i = 0; i <= size && row < rows; i++) {
+        char ch = (i < size) ? text[i] : '\n';
+        if (ch == '\n') {
+            if (col > 0) row++;
+            col = 0;
+            continue;
+        }
+        if (ch == '\r') continue;
+        if (col >= cols) {
+            col++;
+            continue;
+        }
+
+        if (ch == 'J') {
+            if (!foundPlayer) {
+                map->playerRow = row;
+                map->playerCol = col;
+                foundPlayer = true;
+            }
+            ch = ' ';
+        } else if (ch == 'M' || ch == 'R') {
+            if (map->monsterCount == monsterCapacity) {
+                monsterCapacity = monsterCapacity ? monsterCapacity * 2 : 16;
+                MonsterSpawn *monsters = realloc(map->monsters, sizeof(MonsterSpawn) * monsterCapacity);
+                if (!monsters) {
+                    fprintf(stderr, "Erro ao alocar o mapa %s\n", filename);
+                    free(fileText);
+                    free(map->terrain);
+                    free(map->items);
+                    free(map->monsters);
+                    memset(map, 0, sizeof(*map));
+                    return false;
+                }
+                map->monsters = monsters;
+            }
+            map->monsters[map->monsterCount++] = (MonsterSpawn){ row, col, ch == 'R' };
+            ch = ' ';
+        } else if (ch == 'V' || ch == 'T' || AttackKindForItem(ch) >= 0) {
+            if (map->itemCount == itemCapacity) {
+                itemCapacity = itemCapacity ? itemCapacity * 2 : 16;
+                Item *items = realloc(map->items, sizeof(Item) * itemCapacity);
+                if (!items) {
+                    fprintf(stderr, "Erro ao alocar o mapa %s\n", filename);
+                    // Ainda não contabilizado: UnloadMap descontaria o que não entrou
+                    free(fileText);
+                    free(map->terrain);
+                    free(map->items);
+                    free(map->monsters);
+                    memset(map, 0, sizeof(*map));
+                    return false;
+                }
+                map->items = items;
+            }
+            map->items[map->itemCount++] = (Item){ row, col, ch };
+            ch = ' ';
+        }
+        TERRAIN_AT(map, row, col) = ch;
+        col++;
+    }
+    free(fileText);
+
+    // Devolve a folga do vetor; se o realloc falhar o bloco maior continua válido
+    if (map->itemCount > 0) {
+        Item *items = realloc(map->items, sizeof(Item) * map->itemCount);
+        if (items) map->items = items;
+    }
+    TrackMemory(MEM_MAP, (int64_t)((size_t)rows * cols + sizeof(Item) * map->itemCount), map->itemCount > 0 ? 2 : 1);
+    if (map->monsterCount > 0) {
+        MonsterSpawn *monsters = realloc(map->monsters, sizeof(MonsterSpawn) * map->monsterCount);
+        if (monsters) map->monsters = monsters;
+        TrackMemory(MEM_MAP, (int64_t)(sizeof(MonsterSpawn) * map->monsterCount), 1);
+    }
+
+    // O .hpa ao lado do mapa (ou no pacote) poupa os clusters que não mudaram
+    // desde que ele foi gerado; sem ele o grafo sai todo do terreno
+    char graphFile[MAP_NAME_LENGTH + 8];
+    PathGraph stored = {0};
+    GetPathGraphFilename(filename, graphFile, sizeof(graphFile));
+    bool hasStored = LoadPathGraph(&stored, map, graphFile);
+    bool built = BuildPathGraph(&map->paths, map, hasStored ? &stored : NULL);
+    FreePathGraph(&stored);
+    if (!built) UnloadMap(map);
+    return built;
+}
+
+void UnloadMap(Map *map) {
+    if (map->terrain) {
+        TrackMemory(MEM_MAP, -(int64_t)((size_t)map->rows * map->cols + sizeof(Item) * map->itemCount), map->itemCount > 0 ? -2 : -1);
+    }
+    if (map->monsterCount > 0) TrackMemory(MEM_MAP, -(int64_t)(sizeof(MonsterSpawn) * map->monsterCount), -1);
+    FreePathGraph(&map->paths);
+    free(map->terrain);
+    free(map->items);
+    free(map->monsters);
+    memset(map, 0, sizeof(*map));
+}
+
+// Devolve o mapa do cache, lendo o arquivo só na primeira vez. Quando o cache
+// enche, sai o mapa sem referências usado há mais tempo. NULL se a leitura
+// falhar (o slot fica vazio)
+// *loadTime recebe quanto o LoadMapFromFile levou (0 se o mapa já estava no cache)
+const Map *AcquireMap(const char *name, double *loadTime) {
+    CachedMap *slot = NULL;
+    for (int i = 0; i < MAP_CACHE_SIZE; i++) {
+        if (mapCache[i].map.terrain && strcmp(mapCache[i].map.name, name) == 0) {
+            slot = &mapCache[i];
+            break;
+        }
+    }
+
+    if (!slot) {
+        for (int i = 0; i < MAP_CACHE_SIZE; i++) {
+            CachedMap *candidate = &mapCache[i];
+            if (candidate->refs > 0) continue;
+            if (!slot || !candidate->map.terrain || (slot->map.terrain && candidate->lastUse < slot->lastUse)) slot = candidate;
+        }
+        UnloadMap(&slot->map);
+        double start = GetTime();
+        if (!LoadMapFromFile(&slot->map, name)) return NULL;
+        if (loadTime) *loadTime = GetTime() - start;
+    }
+
+    slot->refs++;
+    slot->lastUse = ++mapCacheClock;
+    return &slot->map;
+}
+
+void ReleaseMap(const Map *map) {
+    for (int i = 0; i < MAP_CACHE_SIZE; i++) {
+        if (&mapCache[i].map == map && mapCache[i].refs > 0) mapCache[i].refs--;
+    }
+}
+
+void FreeMapCache(void) {
+    for (int i = 0; i < MAP_CACHE_SIZE; i++) {
+        UnloadMap(&mapCache[i].map);
+        mapCache[i].refs = 0;
+    }
+    FreePathSearch(&pathSearch);
+}
+
+// Monta o grafo cluster a cluster. Com um grafo guardado de mesmas
+// dimensões, cada cluster com o mesmo terreno e as mesmas transições copia as
+// distâncias em vez de refazer as buscas: editar um trecho do mapa só recalcula
+// os clusters tocados (e os vizinhos cujas entradas mudaram). Sem memória
+// devolve false com o grafo vazio e nada contabilizado
+bool BuildPathGraph(PathGraph *graph, const Map *map, const PathGraph *stored) {
+    memset(graph, 0, sizeof(*graph));
+    graph->clusterRows = (map->rows + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE;
+    graph->clusterCols = (map->cols + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE;
+    int clusterCount = graph->clusterRows * graph->clusterCols;
+    graph->clusters = calloc(clusterCount > 0 ? clusterCount : 1, sizeof(PathCluster));
+    if (!graph->clusters) return AbortPathGraph(graph, map);
+    bool reuse = stored && stored->clusters && stored->clusterRows == graph->clusterRows &&
+                 stored->clusterCols == graph->clusterCols;
+
+    int nodeCapacity = 0;
+    size_t distCapacity = 0;
+    uint16_t local[PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE];
+    int16_t parent[PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE];
+    int32_t queue[PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE];
+
+    for (int clusterRow = 0; clusterRow < graph->clusterRows; clusterRow++) {
+        for (int clusterCol = 0; clusterCol < graph->clusterCols; clusterCol++) {
+            int32_t cells[PATH_MAX_CLUSTER_NODES];
+            int count = 0;
+            for (int side = 0; side < 4; side++) count += BorderTransitions(map, clusterRow, clusterCol, side, cells + count);
+
+            // Ordena (são poucas) e tira repetidas: um canto pode ser transição de duas bordas
+            for (int i = 1; i < count; i++) {
+                int32_t cell = cells[i];
+                int j = i - 1;
+                while (j >= 0 && cells[j] > cell) {
+                    cells[j + 1] = cells[j];
+                    j--;
+                }
+                cells[j + 1] = cell;
+            }
+            int unique = 0;
+            for (int i = 0; i < count; i++) {
+                if (unique == 0 || cells[unique - 1] != cells[i]) cells[unique++] = cells[i];
+            }
+            count = unique;
+
+            int index = clusterRow * graph->clusterCols + clusterCol;
+            PathCluster *cluster = &graph->clusters[index];
+            cluster->firstNode = graph->nodeCount;
+            cluster->nodeCount = count;
+            cluster->firstDist = graph->distCount;
+            cluster->terrainHash = ClusterTerrainHash(map, clusterRow, clusterCol);
+
+            if (graph->nodeCount + count > nodeCapacity) {
+                nodeCapacity = (graph->nodeCount + count) * 2;
+                int32_t *nodes = realloc(graph->nodes, sizeof(int32_t) * nodeCapacity);
+                if (!nodes) return AbortPathGraph(graph, map);
+                graph->nodes = nodes;
+            }
+            size_t pairs = (size_t)count * count;
+            if (graph->distCount + pairs > distCapacity) {
+                distCapacity = (graph->distCount + pairs) * 2;
+                uint16_t *dist = realloc(graph->dist, sizeof(uint16_t) * distCapacity);
+                if (!dist) return AbortPathGraph(graph, map);
+                graph->dist = dist;
+            }
+            memcpy(graph->nodes + graph->nodeCount, cells, sizeof(int32_t) * count);
+            graph->nodeCount += count;
+            graph->distCount += pairs;
+
+            uint16_t *dist = graph->dist + cluster->firstDist;
+            const PathCluster *old = reuse ? &stored->clusters[index] : NULL;
+            if (old && old->terrainHash == cluster->terrainHash && old->nodeCount == count &&
+                memcmp(stored->nodes + old->firstNode, cells, sizeof(int32_t) * count) == 0) {
+                memcpy(dist, stored->dist + old->firstDist, sizeof(uint16_t) * pairs);
+                continue;
+            }
+
+            int firstRow = clusterRow * PATH_CLUSTER_SIZE, firstCol = clusterCol * PATH_CLUSTER_SIZE;
+            for (int i = 0; i < count; i++) {
+                ClusterBfs(map, clusterRow, clusterCol, cells[i], local, parent, queue);
+                for (int j = 0; j < count; j++) {
+                    int row = cells[j] / map->cols - firstRow, col = cells[j] % map->cols - firstCol;
+                    dist[i * count + j] = local[row * PATH_CLUSTER_SIZE + col];
+                }
+            }
+            graph->rebuiltClusters++;
+        }
+    }
+
+    // Devolve a folga dos vetores; se o realloc falhar o bloco maior continua válido
+    if (graph->nodeCount > 0) {
+        int32_t *nodes = realloc(graph->nodes, sizeof(int32_t) * graph->nodeCount);
+        if (nodes) graph->nodes = nodes;
+    }
+    if (graph->distCount > 0) {
+        uint16_t *dist = realloc(graph->dist, sizeof(uint16_t) * graph->distCount);
+        if (dist) graph->dist = dist;
+    }
+
+    // Arestas entre clusters: cada transição tem o par do outro lado da borda
+    // (duas num canto), resolvidas uma vez aqui em vez de a cada expansão
+    graph->links = malloc(sizeof(int32_t) * 2 * (graph->nodeCount > 0 ? graph->nodeCount : 1));
+    if (!graph->links) return AbortPathGraph(graph, map);
+    for (int i = 0; i < graph->nodeCount; i++) {
+        int row = graph->nodes[i] / map->cols, col = graph->nodes[i] % map->cols;
+        int cluster = (row / PATH_CLUSTER_SIZE) * graph->clusterCols + col / PATH_CLUSTER_SIZE;
+        int next[4][2] = { {row - 1, col}, {row + 1, col}, {row, col - 1}, {row, col + 1} };
+        int count = 0;
+        graph->links[2 * i] = graph->links[2 * i + 1] = -1;
+        for (int d = 0; d < 4 && count < 2; d++) {
+            int r = next[d][0], c = next[d][1];
+            if (r < 0 || r >= map->rows || c < 0 || c >= map->cols) continue;
+            int other = (r / PATH_CLUSTER_SIZE) * graph->clusterCols + c / PATH_CLUSTER_SIZE;
+            if (other == cluster) continue;
+            int v = FindPathNode(graph, other, r * map->cols + c);
+            if (v >= 0) graph->links[2 * i + count++] = v;
+        }
+    }
+    TrackMemory(MEM_MAP, (int64_t)PathGraphBytes(graph), 4);
+    return true;
+}
+
+// Desfaz um BuildPathGraph pela metade: nada foi contabilizado ainda, então o
+// FreePathGraph não serviria
+bool AbortPathGraph(PathGraph *graph, const Map *map) {
+    fprintf(stderr, "Sem memoria para o grafo de caminhos de %s.\n", map->name);
+    free(graph->clusters);
+    free(graph->nodes);
+    free(graph->links);
+    free(graph->dist);
+    memset(graph, 0, sizeof(*graph));
+    return false;
+}
+
+// Transições da borda "side" do cluster (0 acima, 1 abaixo, 2 esquerda,
+// 3 direita), na célula do próprio cluster. Cada trecho contínuo livre dos
+// dois lados vira uma transição no meio, ou duas nas pontas se for longo. O
+// vizinho vê os mesmos trechos, então os dois lados sempre concordam
+int BorderTransitions(const Map *map, int clusterRow, int clusterCol, int side, int32_t *out) {
+    int firstRow = clusterRow * PATH_CLUSTER_SIZE, firstCol = clusterCol * PATH_CLUSTER_SIZE;
+    int lastRow = firstRow + PATH_CLUSTER_SIZE - 1, lastCol = firstCol + PATH_CLUSTER_SIZE - 1;
+    if (lastRow >= map->rows) lastRow = map->rows - 1;
+    if (lastCol >= map->cols) lastCol = map->cols - 1;
+
+    bool vertical = side >= 2;     // borda vertical: anda pelas linhas
+    int own = side == 0 ? firstRow : side == 1 ? lastRow : side == 2 ? firstCol : lastCol;
+    int other = own + ((side == 0 || side == 2) ? -1 : 1);
+    if (other < 0 || other >= (vertical ? map->cols : map->rows)) return 0;
+    int first = vertical ? firstRow : firstCol, last = vertical ? lastRow : lastCol;
+
+    int count = 0, start = -1;
+    for (int i = first; i <= last + 1; i++) {
+        bool open = false;
+        if (i <= last) {
+            open = vertical ? (TERRAIN_AT(map, i, own) == ' ' && TERRAIN_AT(map, i, other) == ' ')
+                            : (TERRAIN_AT(map, own, i) == ' ' && TERRAIN_AT(map, other, i) == ' ');
+        }
+        if (open && start < 0) start = i;
+        if (open || start < 0) continue;
+
+        int end = i - 1;
+        int picks[2] = { start, end };
+        int pickCount = 2;
+        if (end - start + 1 < PATH_ENTRANCE_SPLIT) {
+            picks[0] = (start + end) / 2;
+            pickCount = 1;
+        }
+        for (int p = 0; p < pickCount; p++) {
+            out[count++] = vertical ? picks[p] * map->cols + own : own * map->cols + picks[p];
+        }
+        start = -1;
+    }
+    return count;
+}
+
+uint64_t ClusterTerrainHash(const Map *map, int clusterRow, int clusterCol) {
+    uint64_t hash = FNV_OFFSET;
+    for (int r = clusterRow * PATH_CLUSTER_SIZE; r < (clusterRow + 1) * PATH_CLUSTER_SIZE && r < map->rows; r++) {
+        for (int c = clusterCol * PATH_CLUSTER_SIZE; c < (clusterCol + 1) * PATH_CLUSTER_SIZE && c < map->cols; c++) {
+            hash = HashValue(hash, TERRAIN_AT(map, r, c) == ' ');
+        }
+    }
+    return hash;
+}
+
+// BFS restrita ao cluster a partir de "cell"; dist e parent usam o índice
+// local (linha * PATH_CLUSTER_SIZE + coluna dentro do cluster). O cluster é
+// copiado antes para uma grade com moldura, então a busca não testa limites
+void ClusterBfs(const Map *map, int clusterRow, int clusterCol, int32_t cell, uint16_t *dist, int16_t *parent, int32_t *queue) {
+    int firstRow = clusterRow * PATH_CLUSTER_SIZE, firstCol = clusterCol * PATH_CLUSTER_SIZE;
+    int rows = map->rows - firstRow < PATH_CLUSTER_SIZE ? map->rows - firstRow : PATH_CLUSTER_SIZE;
+    int cols = map->cols - firstCol < PATH_CLUSTER_SIZE ? map->cols - firstCol : PATH_CLUSTER_SIZE;
+    unsigned char open[PATH_CLUSTER_STRIDE * PATH_CLUSTER_STRIDE] = {0};
+    for (int r = 0; r < rows; r++) {
+        const char *line = &TERRAIN_AT(map, firstRow + r, firstCol);
+        unsigned char *out = &open[(r + 1) * PATH_CLUSTER_STRIDE + 1];
+        for (int c = 0; c < cols; c++) out[c] = line[c] == ' ';
+    }
+    memset(dist, 0xff, sizeof(uint16_t) * PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE);
+
+    int startRow = cell / map->cols - firstRow, startCol = cell % map->cols - firstCol;
+    int start = (startRow + 1) * PATH_CLUSTER_STRIDE + startCol + 1;
+    dist[startRow * PATH_CLUSTER_SIZE + startCol] = 0;
+    parent[startRow * PATH_CLUSTER_SIZE + startCol] = -1;
+    open[start] = 0;
+    queue[0] = start;
+    int head = 0, tail = 1;
+    static const int offsets[4] = { -PATH_CLUSTER_STRIDE, PATH_CLUSTER_STRIDE, -1, 1 };
+    while (head < tail) {
+        int current = queue[head++];
+        int local = (current / PATH_CLUSTER_STRIDE - 1) * PATH_CLUSTER_SIZE + current % PATH_CLUSTER_STRIDE - 1;
+        for (int d = 0; d < 4; d++) {
+            int neighbour = current + offsets[d];
+            if (!open[neighbour]) continue;
+            open[neighbour] = 0;
+            int next = (neighbour / PATH_CLUSTER_STRIDE - 1) * PATH_CLUSTER_SIZE + neighbour % PATH_CLUSTER_STRIDE - 1;
+            dist[next] = dist[local] + 1;
+            parent[next] = (int16_t)local;
+            queue[tail++] = neighbour;
+        }
+    }
+}
+
+// Busca binária nos nós do cluster; devolve o índice global ou -1
+int FindPathNode(const PathGraph *graph, int cluster, int32_t cell) {
+    const PathCluster *c = &graph->clusters[cluster];
+    int low = c->firstNode, high = c->firstNode + c->nodeCount - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (graph->nodes[mid] == cell) return mid;
+        if (graph->nodes[mid] < cell) low = mid + 1;
+        else high = mid - 1;
+    }
+    return -1;
+}
+
+// Consulta HPA*: comprimento do caminho de (fromRow, fromCol) até (toRow,
+// toCol) e a primeira célula dele em *stepRow/*stepCol, ou -1 sem caminho.
+// O destino entra no grafo pela BFS do seu cluster e a partida pela do dela;
+// entre os dois roda A* nos nós abstratos, do destino para a partida, com
+// distância de Manhattan até a partida. Só o primeiro trecho é refinado, que
+// é o que um monstro precisa por pensamento
+int FindPathStep(const PathGraph *graph, const Map *map, int fromRow, int fromCol, int toRow, int toCol, int *stepRow, int *stepCol) {
+    if (!graph->clusters) return -1;
+    if (fromRow < 0 || fromRow >= map->rows || fromCol < 0 || fromCol >= map->cols ||
+        toRow < 0 || toRow >= map->rows || toCol < 0 || toCol >= map->cols ||
+        TERRAIN_AT(map, fromRow, fromCol) != ' ' || TERRAIN_AT(map, toRow, toCol) != ' ') {
+        return -1;
+    }
+    *stepRow = fromRow;
+    *stepCol = fromCol;
+    if (fromRow == toRow && fromCol == toCol) return 0;
+
+    PathSearch *search = &pathSearch;
+    int fromClusterRow = fromRow / PATH_CLUSTER_SIZE, fromClusterCol = fromCol / PATH_CLUSTER_SIZE;
+    int fromCluster = fromClusterRow * graph->clusterCols + fromClusterCol;
+    int toCluster = (toRow / PATH_CLUSTER_SIZE) * graph->clusterCols + toCol / PATH_CLUSTER_SIZE;
+    int fromLocal = (fromRow % PATH_CLUSTER_SIZE) * PATH_CLUSTER_SIZE + fromCol % PATH_CLUSTER_SIZE;
+    int toLocal = (toRow % PATH_CLUSTER_SIZE) * PATH_CLUSTER_SIZE + toCol % PATH_CLUSTER_SIZE;
+
+    // Destino novo: nova geração, semeada com os nós do cluster do destino
+    int32_t goal = toRow * map->cols + toCol;
+    if (search->graph != graph || search->goal != goal) {
+        if (!EnsurePathSearch(search, graph->nodeCount)) return -1;
+        if (++search->generation == 0) {
+            for (int i = 0; i < search->capacity; i++) search->visits[i].stamp = 0;
+            search->generation = 1;
+        }
+        search->graph = graph;
+        search->goal = goal;
+        search->openCount = 0;
+        ClusterBfs(map, toRow / PATH_CLUSTER_SIZE, toCol / PATH_CLUSTER_SIZE, goal, search->toDist, search->fromParent, search->queue);
+        const PathCluster *c = &graph->clusters[toCluster];
+        for (int i = c->firstNode; i < c->firstNode + c->nodeCount; i++) {
+            int row = graph->nodes[i] / map->cols, col = graph->nodes[i] % map->cols;
+            int d = search->toDist[(row % PATH_CLUSTER_SIZE) * PATH_CLUSTER_SIZE + col % PATH_CLUSTER_SIZE];
+            if (d == UINT16_MAX) continue;
+            search->visits[i] = (PathVisit){ search->generation, d, -1 };
+            PushPathOpen(search, (PathOpen){ d, d, i });
+        }
+    }
+    RekeyPathSearch(search, map, fromRow, fromCol);
+
+    // Candidatos: direto, se os dois estão no mesmo cluster, e por cada nó
+    // do cluster de partida que a busca já alcançou
+    ClusterBfs(map, fromClusterRow, fromClusterCol, fromRow * map->cols + fromCol, search->fromDist, search->fromParent, search->queue);
+    int best = INT_MAX, bestNode = -1;
+    if (fromCluster == toCluster && search->fromDist[toLocal] != UINT16_MAX) best = search->fromDist[toLocal];
+    const PathCluster *start = &graph->clusters[fromCluster];
+    for (int i = start->firstNode; i < start->firstNode + start->nodeCount; i++) {
+        int row = graph->nodes[i] / map->cols, col = graph->nodes[i] % map->cols;
+        int d = search->fromDist[(row % PATH_CLUSTER_SIZE) * PATH_CLUSTER_SIZE + col % PATH_CLUSTER_SIZE];
+        const PathVisit *visit = &search->visits[i];
+        if (d == UINT16_MAX || visit->stamp != search->generation || d + visit->g >= best) continue;
+        best = d + visit->g;
+        bestNode = i;
+    }
+
+    while (search->openCount > 0 && search->open[0].f < best) {
+        PathOpen current = PopPathOpen(search);
+        int u = current.node;
+        if (current.g != search->visits[u].g) continue;
+
+        // Vizinhos: os outros nós do cluster (distância guardada) e os pares
+        // do outro lado da borda (custo 1)
+        int row = graph->nodes[u] / map->cols, col = graph->nodes[u] % map->cols;
+        int cluster = (row / PATH_CLUSTER_SIZE) * graph->clusterCols + col / PATH_CLUSTER_SIZE;
+        const PathCluster *c = &graph->clusters[cluster];
+        const uint16_t *dist = graph->dist + c->firstDist + (size_t)(u - c->firstNode) * c->nodeCount;
+        for (int j = -2; j < c->nodeCount; j++) {
+            int v = j < 0 ? graph->links[2 * u + 2 + j] : c->firstNode + j;
+            int cost = j < 0 ? 1 : dist[j];
+            if (v < 0 || v == u || cost == UINT16_MAX) continue;
+            int g = current.g + cost;
+            PathVisit *visit = &search->visits[v];
+            if (visit->stamp == search->generation && visit->g <= g) continue;
+            *visit = (PathVisit){ search->generation, g, u };
+            int vRow = graph->nodes[v] / map->cols, vCol = graph->nodes[v] % map->cols;
+            PushPathOpen(search, (PathOpen){ g + abs(vRow - fromRow) + abs(vCol - fromCol), g, v });
+
+            if (vRow / PATH_CLUSTER_SIZE == fromClusterRow && vCol / PATH_CLUSTER_SIZE == fromClusterCol) {
+                int d = search->fromDist[(vRow % PATH_CLUSTER_SIZE) * PATH_CLUSTER_SIZE + vCol % PATH_CLUSTER_SIZE];
+                if (d != UINT16_MAX && d + g < best) {
+                    best = d + g;
+                    bestNode = v;
+                }
+            }
+        }
+    }
+    if (best == INT_MAX) return -1;
+
+    // Primeiro passo: pela BFS da partida até o nó escolhido ou, se a partida
+    // é o próprio nó, até o seguinte (que pode já ser o outro lado da borda)
+    int target = toLocal;
+    if (bestNode >= 0) {
+        int node = graph->nodes[bestNode] == fromRow * map->cols + fromCol ? search->visits[bestNode].next : bestNode;
+        if (node >= 0) {
+            int row = graph->nodes[node] / map->cols, col = graph->nodes[node] % map->cols;
+            if (row / PATH_CLUSTER_SIZE != fromClusterRow || col / PATH_CLUSTER_SIZE != fromClusterCol) {
+                *stepRow = row;
+                *stepCol = col;
+                return best;
+            }
+            target = (row % PATH_CLUSTER_SIZE) * PATH_CLUSTER_SIZE + col % PATH_CLUSTER_SIZE;
+        }
+    }
+    while (search->fromParent[target] != fromLocal) target = search->fromParent[target];
+    *stepRow = fromClusterRow * PATH_CLUSTER_SIZE + target / PATH_CLUSTER_SIZE;
+    *stepCol = fromClusterCol * PATH_CLUSTER_SIZE + target % PATH_CLUSTER_SIZE;
+    return best;
+}
+
+// Cresce os vetores por nó até o tamanho do maior grafo já consultado; numa
+// fase em andamento isso só aloca na primeira busca
+bool EnsurePathSearch(PathSearch *search, int nodeCount) {
+    if (nodeCount <= search->capacity) return true;
+    PathVisit *visits = realloc(search->visits, sizeof(PathVisit) * nodeCount);
+    if (!visits) {
+        fprintf(stderr, "Sem memoria para a busca de caminhos.\n");
+        return false;
+    }
+    search->visits = visits;
+    memset(search->visits + search->capacity, 0, sizeof(PathVisit) * (nodeCount - search->capacity));
+    TrackMemory(MEM_MONSTERS, (int64_t)sizeof(PathVisit) * (nodeCount - search->capacity), search->capacity == 0 ? 1 : 0);
+    search->capacity = nodeCount;
+    return true;
+}
+
+// Empate no f sai primeiro o de maior g (mais perto do destino)
+void PushPathOpen(PathSearch *search, PathOpen entry) {
+    if (search->openCount == search->openCapacity) {
+        int capacity = search->openCapacity ? search->openCapacity * 2 : 256;
+        PathOpen *open = realloc(search->open, sizeof(PathOpen) * capacity);
+        if (!open) return;
+        TrackMemory(MEM_MONSTERS, (int64_t)sizeof(PathOpen) * (capacity - search->openCapacity), search->open ? 0 : 1);
+        search->open = open;
+        search->openCapacity = capacity;
+    }
+    int i = search->openCount++;
+    while (i > 0) {
+        int up = (i - 1) / 2;
+        PathOpen *p = &search->open[up];
+        if (p->f < entry.f || (p->f == entry.f && p->g >= entry.g)) break;
+        search->open[i] = *p;
+        i = up;
+    }
+    search->open[i] = entry;
+}
+
+// Troca a heurística para a nova partida: recalcula f da borda da busca e
+// refaz o heap, descartando as entradas velhas. Os nós já fechados têm a
+// distância exata ao destino, qualquer que seja a partida
+void RekeyPathSearch(PathSearch *search, const Map *map, int fromRow, int fromCol) {
+    int count = 0;
+    for (int i = 0; i < search->openCount; i++) {
+        PathOpen entry = search->open[i];
+        if (entry.g != search->visits[entry.node].g) continue;
+        int32_t cell = search->graph->nodes[entry.node];
+        entry.f = entry.g + abs(cell / map->cols - fromRow) + abs(cell % map->cols - fromCol);
+        search->open[count++] = entry;
+    }
+    search->openCount = count;
+    for (int i = count / 2 - 1; i >= 0; i--) SiftPathOpen(search, i);
+}
+
+PathOpen PopPathOpen(PathSearch *search) {
+    PathOpen top = search->open[0];
+    search->open[0] = search->open[--search->openCount];
+    SiftPathOpen(search, 0);
+    return top;
+}
+
+void SiftPathOpen(PathSearch *search, int index) {
+    PathOpen entry = search->open[index];
+    int i = index;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= search->openCount) break;
+        PathOpen *a = &search->open[child];
+        if (child + 1 < search->openCount) {
+            PathOpen *b = &search->open[child + 1];
+            if (b->f < a->f || (b->f == a->f && b->g > a->g)) a = b, child++;
+        }
+        if (entry.f < a->f || (entry.f == a->f && entry.g >= a->g)) break;
+        search->open[i] = *a;
+        i = child;
+    }
+    search->open[i] = entry;
+}
+
+void FreePathSearch(PathSearch *search) {
+    if (search->capacity > 0) TrackMemory(MEM_MONSTERS, -(int64_t)sizeof(PathVisit) * search->capacity, -1);
+    if (search->openCapacity > 0) TrackMemory(MEM_MONSTERS, -(int64_t)sizeof(PathOpen) * search->openCapacity, -1);
+    free(search->visits);
+    free(search->open);
+    memset(search, 0, sizeof(*search));
+}
+
+size_t PathGraphBytes(const PathGraph *graph) {
+    return sizeof(PathCluster) * graph->clusterRows * graph->clusterCols + sizeof(int32_t) * graph->nodeCount +
+           (graph->links ? sizeof(int32_t) * 2 * graph->nodeCount : 0) + sizeof(uint16_t) * graph->distCount;
+}
+
+void FreePathGraph(PathGraph *graph) {
+    if (graph->clusters) TrackMemory(MEM_MAP, -(int64_t)PathGraphBytes(graph), graph->links ? -4 : -3);
+    if (pathSearch.graph == graph) pathSearch.graph = NULL;
+    free(graph->clusters);
+    free(graph->nodes);
+    free(graph->links);
+    free(graph->dist);
+    memset(graph, 0, sizeof(*graph));
+}
+
+// mapa01.txt -> mapa01.hpa
+void GetPathGraphFilename(const char *mapName, char *out, size_t size) {
+    const char *dot = strrchr(mapName, '.');
+    int length = dot ? (int)(dot - mapName) : (int)strlen(mapName);
+    snprintf(out, size, "%.*s.hpa", length, mapName);
+}
+
+// Grafo de caminhos: cabeçalho "ZHPA" (ver SealPayload)
+//   payload: dimensões do mapa e dos clusters e, por cluster, o hash do
+//   terreno, as células dos nós (em diferenças) e as distâncias (0 = sem caminho)
+bool SavePathGraph(const PathGraph *graph, const Map *map, const char *filename) {
+    ByteWriter writer = {0};
+    unsigned char header[SAVE_HEADER_SIZE] = {0};
+    WriteBytes(&writer, header, SAVE_HEADER_SIZE);
+
+    WriteVarU(&writer, map->rows);
+    WriteVarU(&writer, map->cols);
+    WriteVarU(&writer, PATH_CLUSTER_SIZE);
+    int clusterCount = graph->clusterRows * graph->clusterCols;
+    for (int i = 0; i < clusterCount; i++) {
+        const PathCluster *cluster = &graph->clusters[i];
+        WriteVarU(&writer, cluster->terrainHash);
+        WriteVarU(&writer, cluster->nodeCount);
+        int32_t previous = 0;
+        for (int j = 0; j < cluster->nodeCount; j++) {
+            WriteVarU(&writer, graph->nodes[cluster->firstNode + j] - previous);
+            previous = graph->nodes[cluster->firstNode + j];
+        }
+        size_t pairs = (size_t)cluster->nodeCount * cluster->nodeCount;
+        for (size_t j = 0; j < pairs; j++) {
+            uint16_t d = graph->dist[cluster->firstDist + j];
+            WriteVarU(&writer, d == UINT16_MAX ? 0 : d + 1u);
+        }
+    }
+
+    SealPayload(&writer, PATH_GRAPH_MAGIC, PATH_GRAPH_VERSION);
+    bool success = WriteFileAtomic(filename, writer.data, writer.size);
+    FreeByteWriter(&writer);
+    return success;
+}
+
+// Lê um .hpa do pacote ou do disco. Dimensões diferentes das do mapa
+// invalidam o arquivo inteiro; diferenças de terreno são resolvidas por
+// cluster no BuildPathGraph
+bool LoadPathGraph(PathGraph *graph, const Map *map, const char *filename) {
+    memset(graph, 0, sizeof(*graph));
+    int size = 0;
+    const unsigned char *data = FindPackEntry(&gamePack, filename, &size);
+    unsigned char *fileData = NULL;
+    if (!data) {
+        if (!GameFileExists(filename)) return false;
+        fileData = LoadFileData(filename, &size);
+        data = fileData;
+        if (!data) return false;
+    }
+
+    ByteReader r;
+    bool valid = OpenPayload(data, (size_t)size, PATH_GRAPH_MAGIC, PATH_GRAPH_VERSION, &r) &&
+                 ReadVarU(&r) == (uint64_t)map->rows && ReadVarU(&r) == (uint64_t)map->cols &&
+                 ReadVarU(&r) == PATH_CLUSTER_SIZE && !r.error;
+    if (valid) {
+        graph->clusterRows = (map->rows + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE;
+        graph->clusterCols = (map->cols + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE;
+        int clusterCount = graph->clusterRows * graph->clusterCols;
+        graph->clusters = calloc(clusterCount > 0 ? clusterCount : 1, sizeof(PathCluster));
+        int nodeCapacity = 0;
+        size_t distCapacity = 0;
+        for (int i = 0; i < clusterCount && valid && graph->clusters; i++) {
+            PathCluster *cluster = &graph->clusters[i];
+            cluster->terrainHash = ReadVarU(&r);
+            uint64_t count = ReadVarU(&r);
+            if (r.error || count > PATH_MAX_CLUSTER_NODES) {
+                valid = false;
+                break;
+            }
+            cluster->firstNode = graph->nodeCount;
+            cluster->nodeCount = (int)count;
+            cluster->firstDist = graph->distCount;
+            size_t pairs = (size_t)count * count;
+            if (graph->nodeCount + (int)count > nodeCapacity) {
+                nodeCapacity = (graph->nodeCount + (int)count) * 2;
+                int32_t *nodes = realloc(graph->nodes, sizeof(int32_t) * nodeCapacity);
+                if (!nodes) {
+                    valid = false;
+                    break;
+                }
+                graph->nodes = nodes;
+            }
+            if (graph->distCount + pairs > distCapacity) {
+                distCapacity = (graph->distCount + pairs) * 2;
+                uint16_t *dist = realloc(graph->dist, sizeof(uint16_t) * distCapacity);
+                if (!dist) {
+                    valid = false;
+                    break;
+                }
+                graph->dist = dist;
+            }
+            int32_t cell = 0;
+            for (uint64_t j = 0; j < count; j++) {
+                cell += (int32_t)ReadVarU(&r);
+                graph->nodes[graph->nodeCount++] = cell;
+            }
+            for (size_t j = 0; j < pairs; j++) {
+                uint64_t d = ReadVarU(&r);
+                graph->dist[graph->distCount++] = d == 0 || d > UINT16_MAX ? UINT16_MAX : (uint16_t)(d - 1);
+            }
+            if (r.error) valid = false;
+        }
+        if (!graph->clusters) valid = false;
+    }
+    if (fileData) UnloadFileData(fileData);
+
+    if (!valid) {
+        free(graph->clusters);
+        free(graph->nodes);
+        free(graph->dist);
+        memset(graph, 0, sizeof(*graph));
+        fprintf(stderr, "Grafo de caminhos %s invalido, sera refeito.\n", filename);
+        return false;
+    }
+    TrackMemory(MEM_MAP, (int64_t)PathGraphBytes(graph), 3);
+    return true;
+}
+
+// Modo --hpa: monta (reaproveitando o .hpa anterior) e grava o grafo de cada mapa
+int BuildPathGraphFiles(char **maps, int count) {
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        Map map;
+        double start = MonotonicTime();
+        if (!LoadMapFromFile(&map, maps[i])) {
+            failures++;
+            continue;
+        }
+        double elapsed = MonotonicTime() - start;
+        char graphFile[MAP_NAME_LENGTH + 8];
+        GetPathGraphFilename(maps[i], graphFile, sizeof(graphFile));
+        const PathGraph *graph = &map.paths;
+        if (SavePathGraph(graph, &map, graphFile)) {
+            printf("%s: %d clusters (%d refeitos), %d nos, %zu KB em %.1f ms -> %s\n", maps[i],
+                   graph->clusterRows * graph->clusterCols, graph->rebuiltClusters, graph->nodeCount,
+                   PathGraphBytes(graph) >> 10, elapsed * 1000.0, graphFile);
+        } else {
+            fprintf(stderr, "Erro ao gravar %s.\n", graphFile);
+            failures++;
+        }
+        UnloadMap(&map);
+    }
+    return failures == 0;
+}
+
+// Relógio das ferramentas de linha de comando: sem janela o timer da raylib
+// (GetTime) não foi iniciado. No Windows o clock_gettime vem da winpthreads,
+// a mesma biblioteca que já fornece as threads
+double MonotonicTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// Busca binária pela célula; devolve o índice do item ou -1
+int FindItemAt(const Map *map, int row, int col) {
+    int cell = row * map->cols + col;
+    int low = 0, high = map->itemCount - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int midCell = map->items[mid].row * map->cols + map->items[mid].col;
+        if (midCell == cell) return mid;
+        if (midCell < cell) low = mid + 1;
+        else high = mid - 1;
+    }
+    return -1;
+}
+
+int MonsterAt(const MonsterManager *monsterManager, int row, int col) {
+    if (row < 0 || row >= monsterManager->rows || col < 0 || col >= monsterManager->cols) return -1;
+    return MONSTER_CELL(monsterManager, row, col) - 1;
+}
+
+// Refaz o índice de ocupação a partir do vetor, depois de ele ser trocado
+// inteiro (início da fase, save carregado, estado do rewind)
+void RebuildMonsterCells(MonsterManager *monsterManager) {
+    memset(monsterManager->cells, 0, sizeof(int32_t) * monsterManager->rows * monsterManager->cols);
+    for (int i = 0; i < monsterManager->count; i++) {
+        const Monster *m = &monsterManager->monsters[i];
+        if (m->active) MONSTER_CELL(monsterManager, m->row, m->col) = i + 1;
+    }
+}
+
+Camera2D UpdateGameCamera(const Map *map, Vector2 focus, int renderScale) {
+    Camera2D camera = {0};
+    camera.zoom = 1.0f / renderScale;
+    camera.offset = (Vector2){VIEW_WIDTH / 2.0f / renderScale, VIEW_HEIGHT / 2.0f / renderScale};
+    if (renderScale == 1) camera.offset.y += HUD_HEIGHT;
+
+    float mapWidth = (float)map->cols * TILE_SIZE;
+    float mapHeight = (float)map->rows * TILE_SIZE;
+    float halfW = VIEW_WIDTH / 2.0f;
+    float halfH = VIEW_HEIGHT / 2.0f;
+
+    camera.target = focus;
+
+    if (mapWidth <= 2 * halfW) camera.target.x = halfW;
+    else camera.target.x = fminf(fmaxf(camera.target.x, halfW), mapWidth - halfW);
+
+    if (mapHeight <= 2 * halfH) camera.target.y = halfH;
+    else camera.target.y = fminf(fmaxf(camera.target.y, halfH), mapHeight - halfH);
+
+    return camera;
+}
+
+// Centro do corpo em pixels do mundo, entre o começo e o fim do último tick
+Vector2 InterpolateBody(int32_t prevX, int32_t prevY, int32_t x, int32_t y, float alpha) {
+    float fx = prevX + (x - prevX) * alpha;
+    float fy = prevY + (y - prevY) * alpha;
+    return (Vector2){ fx * TILE_SIZE / FIXED_ONE, fy * TILE_SIZE / FIXED_ONE };
+}
+
+// Converte a área de jogo da tela em coordenadas de tile; o custo de desenho
+// passa a depender só do tamanho da janela, não do mapa
+// (em qualquer escala a área visível cobre VIEW_WIDTH x VIEW_HEIGHT do mundo)
+TileRange GetVisibleTiles(Camera2D camera, const Map *map) {
+    float left = camera.target.x - VIEW_WIDTH / 2.0f;
+    float top = camera.target.y - VIEW_HEIGHT / 2.0f;
+    float right = left + VIEW_WIDTH;
+    float bottom = top + VIEW_HEIGHT;
+
+    TileRange view;
+    view.firstCol = (int)floorf(left / TILE_SIZE);
+    view.firstRow = (int)floorf(top / TILE_SIZE);
+    view.lastCol = (int)floorf(right / TILE_SIZE);
+    view.lastRow = (int)floorf(bottom / TILE_SIZE);
+
+    if (view.firstCol < 0) view.firstCol = 0;
+    if (view.firstRow < 0) view.firstRow = 0;
+    if (view.lastCol > map->cols - 1) view.lastCol = map->cols - 1;
+    if (view.lastRow > map->rows - 1) view.lastRow = map->rows - 1;
+    return view;
+}
+
+void LocatePlayer(const Map *map, Player *player) {
+    player->swordActive = false;
+    player->weapon = ATTACK_LINE;
+    player->throwables = 0;
+    player->isBlinking = false;
+    player->blinkFrames = 0;
+    player->facingRow = 0;
+    player->facingCol = 1;
+    player->row = map->playerRow;
+    player->col = map->playerCol;
+    player->x = player->prevX = player->col * FIXED_ONE + FIXED_ONE / 2;
+    player->y = player->prevY = player->row * FIXED_ONE + FIXED_ONE / 2;
+}
+
+// Movimento contínuo: velocidade fixa enquanto há direção segurada (a
+// diagonal é normalizada), colisão eixo a eixo contra o terreno. A direção
+// do golpe segue o eixo do movimento; na diagonal fica a que já era de um
+// dos dois eixos. Itens e contato usam a célula do centro do corpo
+void UpdatePlayer(GameSession *game, Player *player, int dirRow, int dirCol, SoundSystem *sounds) {
+    const Map *map = game->map;
+
+    if (dirRow != 0 && dirCol == 0) {
+        player->facingRow = dirRow;
+        player->facingCol = 0;
+    } else if (dirCol != 0 && (dirRow == 0 || (player->facingRow != dirRow && player->facingCol != dirCol))) {
+        player->facingRow = 0;
+        player->facingCol = dirCol;
+    }
+
+    int speed = (dirRow && dirCol) ? PLAYER_SPEED * 181 / 256 : PLAYER_SPEED;
+    MoveBody(map, &player->x, &player->y, dirCol * speed, dirRow * speed, PLAYER_HALF);
+    player->row = player->y >> FIXED_SHIFT;
+    player->col = player->x >> FIXED_SHIFT;
+
+    if (MonsterAt(&game->monsterManager, player->row, player->col) >= 0) HurtPlayer(player, sounds);
+
+    int item = FindItemAt(map, player->row, player->col);
+    if (item >= 0 && game->itemActive[item]) {
+        QueueSound(sounds, SFX_PICKUP);
+        if (map->items[item].type == 'V') {
+            player->lives++;
+            player->score += LIFE_SCORE;
+        } else if (map->items[item].type == 'T') {
+            player->throwables += THROWABLE_PICKUP;
+        } else {
+            player->score += SWORD_SCORE;
+            player->swordActive = true;
+            player->weapon = (AttackKind)AttackKindForItem(map->items[item].type);
+        }
+        game->itemActive[item] = 0;
+        game->itemHash ^= ItemHashKey(map, item);
+    }
+}
+
+// Move uma caixa de meia largura "half" centrada em (x, y), um eixo por vez:
+// se o passo no eixo entra numa parede, a caixa para encostada nela e o
+// outro eixo ainda anda (desliza na parede). Cada passo é menor que um tile,
+// então basta olhar as células da borda que avançou. Retorna true se bateu
+bool MoveBody(const Map *map, int32_t *x, int32_t *y, int dx, int dy, int half) {
+    bool blocked = false;
+    if (dx != 0) {
+        int32_t nx = *x + dx;
+        if (BoxHitsWall(map, nx, *y, half)) {
+            blocked = true;
+            if (dx > 0) nx = ((nx + half) >> FIXED_SHIFT) * FIXED_ONE - 1 - half;
+            else nx = (((nx - half) >> FIXED_SHIFT) + 1) * FIXED_ONE + half;
+        }
+        *x = nx;
+    }
+    if (dy != 0) {
+        int32_t ny = *y + dy;
+        if (BoxHitsWall(map, *x, ny, half)) {
+            blocked = true;
+            if (dy > 0) ny = ((ny + half) >> FIXED_SHIFT) * FIXED_ONE - 1 - half;
+            else ny = (((ny - half) >> FIXED_SHIFT) + 1) * FIXED_ONE + half;
+        }
+        *y = ny;
+    }
+    return blocked;
+}
+
+// Fora do mapa conta como parede
+bool BoxHitsWall(const Map *map, int32_t x, int32_t y, int half) {
+    int firstRow = (y - half) >> FIXED_SHIFT, lastRow = (y + half) >> FIXED_SHIFT;
+    int firstCol = (x - half) >> FIXED_SHIFT, lastCol = (x + half) >> FIXED_SHIFT;
+    for (int r = firstRow; r <= lastRow; r++) {
+        for (int c = firstCol; c <= lastCol; c++) {
+            if (r < 0 || r >= map->rows || c < 0 || c >= map->cols || TERRAIN_AT(map, r, c) == 'P') return true;
+        }
+    }
+    return false;
+}
+
+void DrawHUD(const Player *player, int renderScale) {
+    DrawRectangle(0, 0, SCREENWIDTH, HUD_HEIGHT, DARKGRAY);
+    DrawText(TextFormat("Pontuacao: %d", player->score), 20, 20, 20, WHITE);
+    DrawText(TextFormat("Vidas: %d", player->lives), 300, 20, 20, WHITE);
+    DrawText(TextFormat("Nivel: %d", player->level), 550, 20, 20, WHITE);
+
+    if (player->swordActive) {
+        DrawText(TextFormat("%s ATIVA", attackDefs[player->weapon].name), 800, 20, 20, attackDefs[player->weapon].color);
+    }
+    if (player->throwables > 0) {
+        DrawText(TextFormat("Facas: %d", player->throwables), 680, 20, 20, SKYBLUE);
+    }
+
+    DrawText(TextFormat("F2 Res: 1/%d", renderScale), 1040, 20, 20, LIGHTGRAY);
+}
+
+// Terreno e, por cima, as entidades da camada dinâmica que caem na área visível
+void DrawMap(const GameSession *game, const Player *player, TileRange view) {
+    const Map *map = game->map;
+
+    for (int i = view.firstRow; i <= view.lastRow; i++) {
+        for (int j = view.firstCol; j <= view.lastCol; j++) {
+            Rectangle tile = {j * TILE_SIZE, i * TILE_SIZE, TILE_SIZE, TILE_SIZE};
+            Color color;
+            switch (TERRAIN_AT(map, i, j)) {
+                case 'P': color = GRAY; break;
+                case ' ': color = RAYWHITE; break;
+                default: color = LIGHTGRAY; break;
+            }
+            DrawRectangleRec(tile, color);
+            DrawRectangleLinesEx(tile, 1, LIGHTGRAY);
+        }
+    }
+
+    // Itens ordenados por célula: as linhas visíveis são um trecho contíguo
+    int low = 0, high = map->itemCount;
+    int firstCell = view.firstRow * map->cols;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (map->items[mid].row * map->cols + map->items[mid].col < firstCell) low = mid + 1;
+        else high = mid;
+    }
+    for (int i = low; i < map->itemCount && map->items[i].row <= view.lastRow; i++) {
+        const Item *item = &map->items[i];
+        if (!game->itemActive[i] || item->col < view.firstCol || item->col > view.lastCol) continue;
+        Rectangle tile = {item->col * TILE_SIZE, item->row * TILE_SIZE, TILE_SIZE, TILE_SIZE};
+        Color color = item->type == 'V' ? GREEN : item->type == 'T' ? SKYBLUE : attackDefs[AttackKindForItem(item->type)].color;
+        DrawRectangleRec(tile, color);
+        DrawRectangleLinesEx(tile, 1, LIGHTGRAY);
+    }
+
+    // A célula lógica pode estar um tile à frente do corpo que desliza, então
+    // a busca no índice de ocupação cobre uma margem de um tile
+    const MonsterManager *monsters = &game->monsterManager;
+    int firstRow = view.firstRow > 0 ? view.firstRow - 1 : 0;
+    int lastRow = view.lastRow < map->rows - 1 ? view.lastRow + 1 : map->rows - 1;
+    int firstCol = view.firstCol > 0 ? view.firstCol - 1 : 0;
+    int lastCol = view.lastCol < map->cols - 1 ? view.lastCol + 1 : map->cols - 1;
+    for (int i = firstRow; i <= lastRow; i++) {
+        for (int j = firstCol; j <= lastCol; j++) {
+            int index = MONSTER_CELL(monsters, i, j) - 1;
+            if (index < 0) continue;
+            const Monster *m = &monsters->monsters[index];
+            Vector2 center = InterpolateBody(m->prevX, m->prevY, m->x, m->y, game->tickAlpha);
+            Rectangle tile = {center.x - TILE_SIZE / 2.0f, center.y - TILE_SIZE / 2.0f, TILE_SIZE, TILE_SIZE};
+            DrawRectangleRec(tile, m->ranged ? MAROON : RED);
+            DrawRectangleLinesEx(tile, 1, LIGHTGRAY);
+        }
+    }
+
+    // Piscando: em metade dos quadros o jogador some e mostra o que está embaixo
+    if (player->isBlinking && (game->frameCount / 5) % 2 == 0) return;
+    Vector2 center = InterpolateBody(player->prevX, player->prevY, player->x, player->y, game->tickAlpha);
+    float size = TILE_SIZE * 2.0f * PLAYER_HALF / FIXED_ONE;
+    Rectangle playerTile = {center.x - size / 2, center.y - size / 2, size, size};
+    DrawRectangleRec(playerTile, player->swordActive ? DARKBLUE : BLUE);
+    DrawRectangleLinesEx(playerTile, 1, LIGHTGRAY);
+}
+
+void UpdateMonsterDeaths(MonsterDeathManager *deaths) {
+    for (int i = 0; i < deaths->count;) {
+        if (--deaths->deaths[i].frameCounter <= 0) {
+            for (int j = i; j < deaths->count - 1; j++) deaths->deaths[j] = deaths->deaths[j + 1];
+            deaths->count--;
+        } else {
+            i++;
+        }
+    }
+}
+
+void DrawMonsterDeaths(const MonsterDeathManager *deaths, TileRange view) {
+    for (int i = 0; i < deaths->count; i++) {
+        const MonsterDeath *d = &deaths->deaths[i];
+        if (d->row >= view.firstRow && d->row <= view.lastRow &&
+            d->col >= view.firstCol && d->col <= view.lastCol) {
+            Rectangle deathTile = {d->col * TILE_SIZE, d->row * TILE_SIZE, TILE_SIZE, TILE_SIZE};
+            float alpha = d->frameCounter / (float)MONSTER_DEATH_DURATION;
+            DrawRectangleRec(deathTile, Fade(RED, alpha));
+        }
+    }
+}
+
+// Devolve quantos monstros o golpe matou. Eles só ficam inativos aqui: o
+// vetor é compactado uma vez no fim do tick (CompactMonsters)
+int PerformAttack(Player *player, AttackEffect *effect,
+                  MonsterDeathManager *deathManager, MonsterManager *monsterManager, SoundSystem *sounds) {
+    if (!player->swordActive) return 0;
+
+    QueueSound(sounds, SFX_ATTACK);
+
+    int facing = FacingIndex(player->facingRow, player->facingCol);
+    const AttackTemplate *attack = &attackTemplates[player->weapon];
+
+    // Cada célula do padrão (no máximo ATTACK_GRID x ATTACK_GRID) consulta o
+    // índice de ocupação: o custo depende do tamanho da arma, nunca de
+    // quantos monstros existem na fase
+    int hits = 0;
+    for (int k = 0; k < attack->offsetCount; k++) {
+        int row = player->row + attack->offsets[facing][k][0];
+        int col = player->col + attack->offsets[facing][k][1];
+        int index = MonsterAt(monsterManager, row, col);
+        if (index < 0) continue;
+
+        monsterManager->monsters[index].active = false;
+        MONSTER_CELL(monsterManager, row, col) = 0;
+        hits++;
+        if (deathManager->count < deathManager->capacity) {
+            deathManager->deaths[deathManager->count++] = (MonsterDeath){ row, col, MONSTER_DEATH_DURATION };
+        }
+        QueueSoundAt(sounds, SFX_MONSTER_DEATH, row, col);
+    }
+
+    // Resultado em lote: pontuação e efeito uma vez por golpe
+    player->score += hits * MONSTER_SCORE;
+    effect->kind = player->weapon;
+    effect->row = player->row;
+    effect->col = player->col;
+    effect->facing = facing;
+    if (hits > 0) {
+        effect->active = 1;
+        effect->frameCounter = ATTACK_DURATION;
+    }
+    return hits;
+}
+
+// Tira do vetor os monstros marcados como inativos, mantendo a ordem; as
+// células deles já foram liberadas quando morreram. O cursor da fila recua
+// o que saiu antes dele, para continuar no mesmo monstro
+void CompactMonsters(MonsterManager *monsterManager, AiScheduler *ai) {
+    int kept = 0;
+    int removedBeforeCursor = 0;
+    for (int i = 0; i < monsterManager->count; i++) {
+        const Monster *m = &monsterManager->monsters[i];
+        if (!m->active) {
+            if (i < ai->cursor) removedBeforeCursor++;
+            continue;
+        }
+        MONSTER_CELL(monsterManager, m->row, m->col) = kept + 1;
+        monsterManager->monsters[kept++] = *m;
+    }
+    monsterManager->count = kept;
+    ai->cursor -= removedBeforeCursor;
+}
+
+// Gira o padrão de cada arma (desenhado para cima) para as quatro direções
+void BuildAttackTemplates(void) {
+    for (int kind = 0; kind < ATTACK_KIND_COUNT; kind++) {
+        AttackTemplate *attack = &attackTemplates[kind];
+        memset(attack, 0, sizeof(*attack));
+        for (int r = 0; r < ATTACK_GRID; r++) {
+            for (int c = 0; c < ATTACK_GRID; c++) {
+                if (attackDefs[kind].pattern[r][c] != '#') continue;
+                int dRow = r - ATTACK_REACH, dCol = c - ATTACK_REACH;
+                int rotated[FACING_COUNT][2] = {
+                    { dRow, dCol },      // cima
+                    { -dRow, -dCol },    // baixo
+                    { -dCol, dRow },     // esquerda
+                    { dCol, -dRow },     // direita
+                };
+                for (int f = 0; f < FACING_COUNT; f++) {
+                    attack->offsets[f][attack->offsetCount][0] = (signed char)rotated[f][0];
+                    attack->offsets[f][attack->offsetCount][1] = (signed char)rotated[f][1];
+                }
+                attack->offsetCount++;
+            }
+        }
+    }
+}
+
+// Arma dada por um item do mapa, ou -1 se o item não for uma arma
+int AttackKindForItem(char item) {
+    for (int kind = 0; kind < ATTACK_KIND_COUNT; kind++) {
+        if (attackDefs[kind].item == item) return kind;
     }
     return -1;
 }
 
-void ShowVictoryScreen(Player player, int topPosition) {
-    bool waiting = true;
-    while (waiting && !WindowShouldClose()) {
-        BeginDrawing();
-        ClearBackground(BLACK);
+int FacingIndex(int facingRow, int facingCol) {
+    if (facingRow < 0) return 0;
+    if (facingRow > 0) return 1;
+    return facingCol < 0 ? 2 : 3;
+}
+
+void HurtPlayer(Player *player, SoundSystem *sounds) {
+    if (player->isBlinking) return;
+    QueueSound(sounds, SFX_HURT);
+    player->lives--;
+    player->isBlinking = true;
+    player->blinkFrames = 30;
+}
+
+// Vetores maiores primeiro, então cada um fica alinhado dentro do bloco
+size_t ProjectileArraysBytes(int capacity) {
+    return (size_t)capacity * (2 * sizeof(int32_t) + 3 * sizeof(int16_t) + sizeof(uint8_t));
+}
+
+void BindProjectileArrays(ProjectilePool *pool, unsigned char *block, int capacity) {
+    size_t n = block ? (size_t)capacity : 0;
+    pool->x = (int32_t *)block;
+    pool->y = pool->x + n;
+    pool->vx = (int16_t *)(pool->y + n);
+    pool->vy = pool->vx + n;
+    pool->life = (uint16_t *)(pool->vy + n);
+    pool->owner = (uint8_t *)(pool->life + n);
+    pool->count = 0;
+    pool->capacity = (int)n;
+}
+
+void CopyProjectiles(ProjectilePool *dst, const ProjectilePool *src) {
+    int n = src->count < dst->capacity ? src->count : dst->capacity;
+    memcpy(dst->x, src->x, sizeof(int32_t) * n);
+    memcpy(dst->y, src->y, sizeof(int32_t) * n);
+    memcpy(dst->vx, src->vx, sizeof(int16_t) * n);
+    memcpy(dst->vy, src->vy, sizeof(int16_t) * n);
+    memcpy(dst->life, src->life, sizeof(uint16_t) * n);
+    memcpy(dst->owner, src->owner, sizeof(uint8_t) * n);
+    dst->count = n;
+}
+
+// Nasce no centro do corpo de quem atirou; com o pool cheio o tiro é descartado
+bool SpawnProjectile(ProjectilePool *pool, int32_t x, int32_t y, int vx, int vy, ShotOwner owner) {
+    if (pool->count >= pool->capacity) return false;
+    int i = pool->count++;
+    pool->x[i] = x;
+    pool->y[i] = y;
+    pool->vx[i] = (int16_t)vx;
+    pool->vy[i] = (int16_t)vy;
+    pool->life[i] = PROJECTILE_LIFETIME;
+    pool->owner[i] = (uint8_t)owner;
+    return true;
+}
+
+void RemoveProjectile(ProjectilePool *pool, int index) {
+    int last = --pool->count;
+    pool->x[index] = pool->x[last];
+    pool->y[index] = pool->y[last];
+    pool->vx[index] = pool->vx[last];
+    pool->vy[index] = pool->vy[last];
+    pool->life[index] = pool->life[last];
+    pool->owner[index] = pool->owner[last];
+}
+
+// Monstros 'R' atiram no jogador quando ele está a até RANGED_RANGE tiles.
+// A mira é normalizada pelo maior eixo, só com inteiros, para o resultado
+// ser o mesmo em qualquer máquina
+void FireRangedMonsters(GameSession *game, const Player *player, SoundSystem *sounds) {
+    for (int i = 0; i < game->monsterManager.count; i++) {
+        Monster *m = &game->monsterManager.monsters[i];
+        if (!m->active || !m->ranged || --m->cooldown > 0) continue;
+        m->cooldown = RANGED_FIRE_INTERVAL;
+
+        int dRow = player->row - m->row, dCol = player->col - m->col;
+        int distance = abs(dRow) > abs(dCol) ? abs(dRow) : abs(dCol);
+        if (distance == 0 || distance > RANGED_RANGE) continue;
+        if (SpawnProjectile(&game->projectiles, m->x, m->y, dCol * MONSTER_SHOT_SPEED / distance,
+                            dRow * MONSTER_SHOT_SPEED / distance, SHOT_MONSTER)) {
+            QueueSoundAt(sounds, SFX_ATTACK, m->row, m->col);
+        }
+    }
+}
+
+void ThrowItem(GameSession *game, Player *player, SoundSystem *sounds) {
+    if (player->throwables <= 0) return;
+    if (!SpawnProjectile(&game->projectiles, player->x, player->y, player->facingCol * THROW_SPEED,
+                         player->facingRow * THROW_SPEED, SHOT_PLAYER)) return;
+    player->throwables--;
+    QueueSound(sounds, SFX_ATTACK);
+}
+
+// Avança todos os projéteis um tick. Cada deslocamento é varrido célula a
+// célula pela grade (DDA em inteiros, comparando os tempos de cruzamento por
+// multiplicação cruzada), então nada atravessa parede nem entidade mesmo
+// numa diagonal. Um projétil parado dentro de um monstro que chegou até ele
+// também acerta, exceto no tick em que nasce. Devolve quantos monstros
+// morreram; eles saem do vetor no fim do tick, junto com os do golpe
+int UpdateProjectiles(GameSession *game, Player *player, SoundSystem *sounds) {
+    ProjectilePool *pool = &game->projectiles;
+    int kills = 0;
+
+    for (int i = 0; i < pool->count;) {
+        ShotOwner owner = (ShotOwner)pool->owner[i];
+        int32_t x0 = pool->x[i], y0 = pool->y[i];
+        int32_t x1 = x0 + pool->vx[i], y1 = y0 + pool->vy[i];
+        int cellCol = x0 >> FIXED_SHIFT, cellRow = y0 >> FIXED_SHIFT;
+        int endCol = x1 >> FIXED_SHIFT, endRow = y1 >> FIXED_SHIFT;
+
+        bool stopped = pool->life[i] < PROJECTILE_LIFETIME &&
+                       ProjectileStrikes(game, player, owner, cellRow, cellCol, &kills, sounds);
+        int64_t dx = x1 - x0, dy = y1 - y0;
+        while (!stopped && (cellCol != endCol || cellRow != endRow)) {
+            int64_t boundaryX = dx > 0 ? (int64_t)(cellCol + 1) * FIXED_ONE : (int64_t)cellCol * FIXED_ONE;
+            int64_t boundaryY = dy > 0 ? (int64_t)(cellRow + 1) * FIXED_ONE : (int64_t)cellRow * FIXED_ONE;
+            // Cruza primeiro a borda vertical se |bx - x0| / |dx| <= |by - y0| / |dy|
+            bool stepX = cellCol != endCol &&
+                         (cellRow == endRow || llabs(boundaryX - x0) * llabs(dy) <= llabs(boundaryY - y0) * llabs(dx));
+            if (stepX) cellCol += dx > 0 ? 1 : -1;
+            else cellRow += dy > 0 ? 1 : -1;
+            stopped = ProjectileStrikes(game, player, owner, cellRow, cellCol, &kills, sounds);
+        }
+
+        if (stopped || --pool->life[i] == 0) {
+            RemoveProjectile(pool, i);
+            continue;
+        }
+        pool->x[i] = x1;
+        pool->y[i] = y1;
+        i++;
+    }
+    return kills;
+}
+
+// Efeito de um projétil ao entrar numa célula; true se ele para ali
+bool ProjectileStrikes(GameSession *game, Player *player, ShotOwner owner, int row, int col, int *kills, SoundSystem *sounds) {
+    const Map *map = game->map;
+    if (row < 0 || row >= map->rows || col < 0 || col >= map->cols || TERRAIN_AT(map, row, col) == 'P') return true;
+
+    if (owner == SHOT_MONSTER) {
+        if (row != player->row || col != player->col) return false;
+        HurtPlayer(player, sounds);
+        return true;
+    }
+
+    int index = MonsterAt(&game->monsterManager, row, col);
+    if (index < 0) return false;
+    game->monsterManager.monsters[index].active = false;
+    MONSTER_CELL(&game->monsterManager, row, col) = 0;
+    (*kills)++;
+    MonsterDeathManager *deaths = &game->deathManager;
+    if (deaths->count < deaths->capacity) deaths->deaths[deaths->count++] = (MonsterDeath){ row, col, MONSTER_DEATH_DURATION };
+    QueueSoundAt(sounds, SFX_MONSTER_DEATH, row, col);
+    player->score += MONSTER_SCORE;
+    return true;
+}
+
+void DrawProjectiles(const ProjectilePool *pool, TileRange view) {
+    for (int i = 0; i < pool->count; i++) {
+        int col = pool->x[i] >> FIXED_SHIFT, row = pool->y[i] >> FIXED_SHIFT;
+        if (row < view.firstRow || row > view.lastRow || col < view.firstCol || col > view.lastCol) continue;
+        Vector2 center = { pool->x[i] * (float)TILE_SIZE / FIXED_ONE, pool->y[i] * (float)TILE_SIZE / FIXED_ONE };
+        DrawCircleV(center, TILE_SIZE / 8.0f, pool->owner[i] == SHOT_PLAYER ? SKYBLUE : MAROON);
+    }
+}
+
+                        void InitializeMonsters(const Map *map, MonsterManager *monsterManager) {
+                            monsterManager->count = map->monsterCount;
+                            for (int i = 0; i < map->monsterCount; i++) {
+                                Monster *m = &monsterManager->monsters[i];
+                                *m = (Monster){ .row = map->monsters[i].row, .col = map->monsters[i].col, .active = true,
+                                               .ranged = map->monsters[i].ranged, .cooldown = RANGED_FIRE_INTERVAL };
+                                m->x = m->prevX = m->col * FIXED_ONE + FIXED_ONE / 2;
+                                m->y = m->prevY = m->row * FIXED_ONE + FIXED_ONE / 2;
+                            }
+                            RebuildMonsterCells(monsterManager);
+                        }
+
+                        // Pensamento do nível médio: um passo pelo caminho hierárquico até o
+                        // jogador e, sem caminho ou com a célula ocupada, na direção sorteada
+                        void ThinkMonster(const Map *map, MonsterManager *monsterManager, int index, Player *player, GameRng *rng, SoundSystem *sounds) {
+                                Monster *m = &monsterManager->monsters[index];
+                                if (!m->active) return;
+
+                                // O RNG anda igual para todos, deslizando ou não
+                                int direction = RngNext(rng) % 4;
+                                if (m->steps > 0) return;
+
+                                int stepRow, stepCol;
+                                if (FindPathStep(&map->paths, map, m->row, m->col, player->row, player->col, &stepRow, &stepCol) > 0 &&
+                                    StepMonster(map, monsterManager, m, stepRow - m->row, stepCol - m->col, player, sounds)) return;
+
+                                int dRow = 0, dCol = 0;
+                                if (direction == 0) dRow = -1; else if (direction == 1) dRow = 1;
+                                else if (direction == 2) dCol = -1; else if (direction == 3) dCol = 1;
+                                StepMonster(map, monsterManager, m, dRow, dCol, player, sounds);
+                        }
+
+                        // Pensamento do nível perto: desce o campo de distância até o
+                        // jogador. Quem está fora do campo (cercado por paredes na janela)
+                        // ou bloqueado por outro monstro espera a vez na fila
+                        void ChaseMonster(const Map *map, MonsterManager *monsterManager, int index, Player *player, const DistanceField *field, SoundSystem *sounds) {
+                                static const int dirs[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+                                Monster *m = &monsterManager->monsters[index];
+                                if (!m->active || m->steps > 0) return;
+
+                                int here = FieldDistance(field, m->row, m->col);
+                                if (here == UINT16_MAX) return;
+                                if (m->ranged && here <= RANGED_KEEP_DISTANCE) return;
+                                for (int d = 0; d < 4; d++) {
+                                    if (FieldDistance(field, m->row + dirs[d][0], m->col + dirs[d][1]) >= here) continue;
+                                    if (StepMonster(map, monsterManager, m, dirs[d][0], dirs[d][1], player, sounds)) return;
+                                }
+                        }
+
+                        // Reserva a célula vizinha e começa a deslizar até ela; na célula
+                        // do jogador ataca e descansa um intervalo parado (steps sem
+                        // velocidade). Retorna false se o caminho estiver bloqueado
+                        bool StepMonster(const Map *map, MonsterManager *monsterManager, Monster *m, int dRow, int dCol, Player *player, SoundSystem *sounds) {
+                                int newRow = m->row + dRow;
+                                int newCol = m->col + dCol;
+
+                                // Itens não bloqueiam nem são destruídos: ficam em outra camada
+                                if (newRow < 0 || newRow >= map->rows || newCol < 0 || newCol >= map->cols) return false;
+                                if (newRow == player->row && newCol == player->col) {
+                                    HurtPlayer(player, sounds);
+                                    m->vx = m->vy = 0;
+                                    m->steps = MONSTER_MOVE_INTERVAL;
+                                    return true;
+                                }
+                                if (TERRAIN_AT(map, newRow, newCol) != ' ' || MonsterAt(monsterManager, newRow, newCol) >= 0) return false;
+                                MONSTER_CELL(monsterManager, m->row, m->col) = 0;
+                                MONSTER_CELL(monsterManager, newRow, newCol) = (int32_t)(m - monsterManager->monsters) + 1;
+                                m->row = newRow;
+                                m->col = newCol;
+                                m->vx = (int16_t)(dCol * MONSTER_SPEED);
+                                m->vy = (int16_t)(dRow * MONSTER_SPEED);
+                                m->steps = FIXED_ONE / MONSTER_SPEED;
+                                return true;
+                        }
+
+// Monstros perto pensam todo tick, fora do orçamento: são no máximo os que
+// cabem na tela. A fila pensa até "limit" por tick, na ordem circular a
+// partir do cursor, com uma consulta ao grafo de caminhos (para os perto isso
+// só desfaz bloqueios); os de longe passam pela fila sem custo. O acúmulo é
+// limitado a uma volta completa: atraso maior que isso não faria ninguém
+// pensar mais de uma vez, só viraria uma rajada depois
+int RunAiScheduler(GameSession *game, Player *player, int limit, SoundSystem *sounds) {
+    MonsterManager *monsters = &game->monsterManager;
+    AiScheduler *ai = &game->ai;
+    double start = GetTime();
+
+    int lodCounts[AI_LOD_COUNT] = {0};
+    DistanceField field = {0};
+    bool fieldReady = false;
+    for (int i = 0; i < monsters->count; i++) {
+        Monster *m = &monsters->monsters[i];
+        if (!m->active) continue;
+        AiLod lod = MonsterLod(m, player);
+        lodCounts[lod]++;
+        if (lod != AI_LOD_NEAR || m->steps > 0) continue;
+        // O campo só é montado no tick em que algum monstro perto está livre
+        if (!fieldReady) fieldReady = BuildDistanceField(&field, game->map, player, &game->frameArena);
+        if (fieldReady) ChaseMonster(game->map, monsters, i, player, &field, sounds);
+    }
+
+    int maxBacklog = monsters->count * MONSTER_MOVE_INTERVAL;
+    ai->backlog += monsters->count;
+    if (ai->backlog > maxBacklog) ai->backlog = maxBacklog;
+
+    int thinks = 0;
+    while (ai->backlog >= MONSTER_MOVE_INTERVAL && thinks < limit) {
+        if (ai->cursor >= monsters->count) ai->cursor = 0;
+        int index = ai->cursor++;
+        ai->backlog -= MONSTER_MOVE_INTERVAL;
+        if (MonsterLod(&monsters->monsters[index], player) == AI_LOD_FAR) continue;
+        ThinkMonster(game->map, monsters, index, player, &game->rng, sounds);
+        thinks++;
+    }
+
+    // Só medição: o resultado do tick não depende do relógio
+    aiBudget.lastUs = (GetTime() - start) * 1e6;
+    aiBudget.lastThinks = thinks;
+    memcpy(aiBudget.lodCounts, lodCounts, sizeof(lodCounts));
+    return thinks;
+}
+
+// Perto é a tela em volta do jogador (pela célula, não pela câmera, para a
+// simulação não depender do desenho); longe é a distância de Chebyshev
+AiLod MonsterLod(const Monster *m, const Player *player) {
+    int dRow = abs(m->row - player->row), dCol = abs(m->col - player->col);
+    if (dRow <= AI_NEAR_ROWS && dCol <= AI_NEAR_COLS) return AI_LOD_NEAR;
+    if (dRow > AI_FAR_TILES || dCol > AI_FAR_TILES) return AI_LOD_FAR;
+    return AI_LOD_MID;
+}
+
+// BFS a partir do jogador na janela perto + margem. O tamanho só depende da
+// tela, então o custo é o mesmo em qualquer mapa
+bool BuildDistanceField(DistanceField *field, const Map *map, const Player *player, Arena *arena) {
+    int firstRow = player->row - AI_NEAR_ROWS - AI_PATH_MARGIN, lastRow = player->row + AI_NEAR_ROWS + AI_PATH_MARGIN;
+    int firstCol = player->col - AI_NEAR_COLS - AI_PATH_MARGIN, lastCol = player->col + AI_NEAR_COLS + AI_PATH_MARGIN;
+    if (firstRow < 0) firstRow = 0;
+    if (firstCol < 0) firstCol = 0;
+    if (lastRow >= map->rows) lastRow = map->rows - 1;
+    if (lastCol >= map->cols) lastCol = map->cols - 1;
+
+    field->firstRow = firstRow;
+    field->firstCol = firstCol;
+    field->rows = lastRow - firstRow + 1;
+    field->cols = lastCol - firstCol + 1;
+    int cells = field->rows * field->cols;
+    field->dist = ArenaAlloc(arena, sizeof(uint16_t) * cells, MEM_MONSTERS);
+    int *queue = ArenaAlloc(arena, sizeof(int) * cells, MEM_MONSTERS);
+    if (!field->dist || !queue) return false;
+
+    memset(field->dist, 0xff, sizeof(uint16_t) * cells);
+    int start = (player->row - firstRow) * field->cols + (player->col - firstCol);
+    field->dist[start] = 0;
+    queue[0] = start;
+    int head = 0, tail = 1;
+    while (head < tail) {
+        int cell = queue[head++];
+        int row = cell / field->cols, col = cell % field->cols;
+        int next[4][2] = { {row - 1, col}, {row + 1, col}, {row, col - 1}, {row, col + 1} };
+        for (int d = 0; d < 4; d++) {
+            int r = next[d][0], c = next[d][1];
+            if (r < 0 || r >= field->rows || c < 0 || c >= field->cols) continue;
+            int neighbour = r * field->cols + c;
+            if (field->dist[neighbour] != UINT16_MAX || TERRAIN_AT(map, firstRow + r, firstCol + c) != ' ') continue;
+            field->dist[neighbour] = field->dist[cell] + 1;
+            queue[tail++] = neighbour;
+        }
+    }
+    return true;
+}
+
+int FieldDistance(const DistanceField *field, int row, int col) {
+    row -= field->firstRow;
+    col -= field->firstCol;
+    if (row < 0 || row >= field->rows || col < 0 || col >= field->cols) return UINT16_MAX;
+    return field->dist[row * field->cols + col];
+}
+
+// Quantos pensamentos cabem no que resta do orçamento do frame, pelo custo
+// médio medido. O primeiro tick do frame sempre pensa ao menos um monstro
+int AiThinkLimit(const AiBudget *budget) {
+    if (budget->budgetUs <= 0) return INT_MAX;
+    double left = budget->budgetUs - budget->spentUs;
+    int limit = left > 0 ? (int)fmin(left / budget->thinkUs, INT_MAX) : 0;
+    if (limit == 0 && budget->spentUs == 0) limit = 1;
+    return limit;
+}
+
+void AccountAiTick(AiBudget *budget) {
+    budget->spentUs += budget->lastUs;
+    if (budget->lastThinks > 0) {
+        double cost = budget->lastUs / budget->lastThinks;
+        budget->thinkUs += (cost - budget->thinkUs) * 0.1;
+        if (budget->thinkUs < 0.01) budget->thinkUs = 0.01;
+    }
+}
+
+// Integra os corpos a cada tick até chegarem ao centro da célula reservada
+void MoveMonsters(const Map *map, MonsterManager *monsterManager) {
+    for (int i = 0; i < monsterManager->count; i++) {
+        Monster *m = &monsterManager->monsters[i];
+        m->prevX = m->x;
+        m->prevY = m->y;
+        if (m->steps == 0) continue;
+        if (MoveBody(map, &m->x, &m->y, m->vx, m->vy, MONSTER_HALF) || --m->steps == 0) {
+            m->x = m->col * FIXED_ONE + FIXED_ONE / 2;
+            m->y = m->row * FIXED_ONE + FIXED_ONE / 2;
+            m->vx = m->vy = 0;
+            m->steps = 0;
+        }
+    }
+}
+
+Scene PauseScene(void) {
+    return (Scene){ .name = "pausa", .update = UpdatePauseScene, .draw = DrawPauseScene, .overlay = true };
+}
+
+void UpdatePauseScene(Scene *scene, App *app) {
+    int *selected = &scene->state.pause.selected;
+
+    if (IsKeyPressed(KEY_DOWN)) *selected = (*selected + 1) % 4;
+    else if (IsKeyPressed(KEY_UP)) *selected = (*selected - 1 + 4) % 4;
+    else if (IsKeyPressed(KEY_ENTER)) {
+        switch ((PauseAction)*selected) {
+            case PAUSE_CONTINUE: PopScene(app); break;
+            case PAUSE_SAVE: ReplaceScene(app, SaveSlotScene(SLOT_SAVE)); break;
+            case PAUSE_RETURN_MENU: PopToMenu(app); break;
+            case PAUSE_EXIT_GAME: app->shouldClose = true; break;
+        }
+    }
+}
+
+void DrawPauseScene(const Scene *scene, const App *app) {
+    (void)app;
+    const char *options[] = {
+        "Continuar",
+        "Salvar Jogo",
+        "Voltar ao Menu Principal",
+        "Fechar o Jogo"
+    };
+
+    DrawRectangle(0, 0, SCREENWIDTH, SCREENHEIGHT, Fade(DARKGRAY, 0.8f));
+
+    DrawText("=== PAUSE MENU ===", (SCREENWIDTH - MeasureText("=== PAUSE MENU ===", 50)) / 2, 200, 50, RAYWHITE);
+
+    for (int i = 0; i < 4; i++) {
+        Color color = (i == scene->state.pause.selected) ? RED : WHITE;
+        DrawText(options[i], (SCREENWIDTH - MeasureText(options[i], 30)) / 2, 300 + i * 50, 30, color);
+    }
+}
+
+bool SaveGameSlot(const GameSession *game, const Player *player, int slot, SlotIndex *index) {
+    if (slot < 1 || slot > MAX_SAVE_SLOTS) {
+        printf("Slot invalido. Escolha entre 1 e %d.\n", MAX_SAVE_SLOTS);
+        return false;
+    }
+
+    char filename[64];
+    GetSlotFilename(slot, filename, sizeof(filename));
+
+    ByteWriter writer = {0};
+    EncodeGameState(&writer, game, player);
+    bool success = WriteFileAtomic(filename, writer.data, writer.size);
+    size_t written = writer.size;
+    FreeByteWriter(&writer);
+
+    RecordFlightEvent(&flightRecorder, TextFormat("save slot %d %s (%zu bytes)", slot, success ? "gravado" : "falhou", written));
+    if (!success) {
+        fprintf(stderr, "Erro ao salvar o jogo no slot %d.\n", slot);
+        return false;
+    }
+
+    // O índice só é atualizado depois que o save está no disco
+    FillSlotInfo(&index->slots[slot], game, player);
+    SaveSlotIndex(index);
+    return true;
+}
+
+void GetSlotFilename(int slot, char *filename, size_t size) {
+    if (slot == AUTOSAVE_SLOT) snprintf(filename, size, "saves/autosave.bin");
+    else snprintf(filename, size, "saves/save_slot%d.bin", slot);
+}
+
+// Grava em um .tmp e só então renomeia: um save interrompido nunca
+// substitui o anterior pela metade
+bool WriteFileAtomic(const char *filename, const void *data, size_t size) {
+    char tempName[256];
+    snprintf(tempName, sizeof(tempName), "%s.tmp", filename);
+
+    FILE *file = fopen(tempName, "wb");
+    if (!file) return false;
+
+    bool success = fwrite(data, 1, size, file) == size;
+    success = (fflush(file) == 0) && success;
+    success = (fclose(file) == 0) && success;
+
+#if defined(_WIN32)
+    if (success) remove(filename);
+#endif
+    if (success && rename(tempName, filename) != 0) success = false;
+    if (!success) remove(tempName);
+    return success;
+}
+
+void InitAutoSaver(AutoSaver *saver) {
+    memset(saver, 0, sizeof(*saver));
+    saver->jobIndex = -1;
+    pthread_mutex_init(&saver->lock, NULL);
+    pthread_cond_init(&saver->wake, NULL);
+    pthread_create(&saver->thread, NULL, AutoSaveWorker, saver);
+}
+
+// Espera a gravação em andamento terminar antes de sair
+void ShutdownAutoSaver(AutoSaver *saver) {
+    pthread_mutex_lock(&saver->lock);
+    saver->quit = true;
+    pthread_cond_signal(&saver->wake);
+    pthread_mutex_unlock(&saver->lock);
+    pthread_join(saver->thread, NULL);
+
+    for (int i = 0; i < 2; i++) {
+        SaveSnapshot *snap = &saver->snapshots[i];
+        TrackMemory(MEM_SAVES, -(int64_t)(snap->itemCapacity + sizeof(MonsterDeath) * snap->deathCapacity +
+                                          sizeof(Monster) * snap->monsterCapacity + ProjectileArraysBytes(snap->shotCapacity)), 0);
+        free(snap->game.itemActive);
+        free(snap->game.deathManager.deaths);
+        free(snap->game.monsterManager.monsters);
+        free(snap->shotData);
+    }
+    pthread_cond_destroy(&saver->wake);
+    pthread_mutex_destroy(&saver->lock);
+}
+
+// Chamado uma vez por frame, com a fase já atualizada: a cada
+// AUTOSAVE_INTERVAL copia o estado para o snapshot livre (só memcpy) e
+// entrega à thread; o jogo nunca espera o disco
+void UpdateAutoSave(AutoSaver *saver, const GameSession *game, const Player *player, SlotIndex *index, float deltaTime) {
+    pthread_mutex_lock(&saver->lock);
+    bool busy = saver->busy;
+    saver->saving = busy;
+    if (saver->finished) {
+        saver->finished = false;
+        saver->toastTime = AUTOSAVE_TOAST_TIME;
+        saver->toastOk = saver->lastResult;
+        RecordFlightEvent(&flightRecorder, saver->lastResult ? "autosave gravado" : "autosave falhou");
+        if (saver->lastResult) {
+            index->slots[AUTOSAVE_SLOT] = saver->pendingInfo;
+            SaveSlotIndex(index);
+        }
+    }
+    pthread_mutex_unlock(&saver->lock);
+
+    if (saver->toastTime > 0) saver->toastTime -= deltaTime;
+    if (!game->active) return;
+
+    saver->timer += deltaTime;
+    if (saver->timer < AUTOSAVE_INTERVAL || busy) return;
+    saver->timer = 0;
+
+    SaveSnapshot *snap = &saver->snapshots[saver->fillIndex];
+    size_t itemCount = (size_t)game->map->itemCount;
+    if (itemCount + 1 > snap->itemCapacity) {
+        // Sem memória pula só este autosave; o buffer antigo continua válido
+        unsigned char *grown = realloc(snap->game.itemActive, itemCount + 1);
+        if (!grown) return;
+        snap->game.itemActive = grown;
+        TrackMemory(MEM_SAVES, (int64_t)(itemCount + 1 - snap->itemCapacity), 0);
+        snap->itemCapacity = itemCount + 1;
+    }
+
+    int deathCount = game->deathManager.count;
+    if (deathCount > snap->deathCapacity) {
+        MonsterDeath *grown = realloc(snap->game.deathManager.deaths, sizeof(MonsterDeath) * deathCount);
+        if (!grown) return;
+        snap->game.deathManager.deaths = grown;
+        TrackMemory(MEM_SAVES, (int64_t)(sizeof(MonsterDeath) * (deathCount - snap->deathCapacity)), 0);
+        snap->deathCapacity = deathCount;
+    }
+
+    int monsterCount = game->monsterManager.count;
+    if (monsterCount > snap->monsterCapacity) {
+        Monster *grown = realloc(snap->game.monsterManager.monsters, sizeof(Monster) * monsterCount);
+        if (!grown) return;
+        snap->game.monsterManager.monsters = grown;
+        TrackMemory(MEM_SAVES, (int64_t)(sizeof(Monster) * (monsterCount - snap->monsterCapacity)), 0);
+        snap->monsterCapacity = monsterCount;
+    }
+
+    int shotCount = game->projectiles.count;
+    if (shotCount > snap->shotCapacity) {
+        unsigned char *grown = realloc(snap->shotData, ProjectileArraysBytes(shotCount));
+        if (!grown) return;
+        snap->shotData = grown;
+        TrackMemory(MEM_SAVES, (int64_t)(ProjectileArraysBytes(shotCount) - ProjectileArraysBytes(snap->shotCapacity)), 0);
+        snap->shotCapacity = shotCount;
+    }
+
+    unsigned char *itemActive = snap->game.itemActive;
+    MonsterDeath *deaths = snap->game.deathManager.deaths;
+    Monster *monsters = snap->game.monsterManager.monsters;
+    snap->game = *game;
+    snap->game.itemActive = itemActive;
+    snap->game.deathManager.deaths = deaths;
+    snap->game.deathManager.capacity = snap->deathCapacity;
+    snap->game.monsterManager.monsters = monsters;
+    snap->game.monsterManager.capacity = snap->monsterCapacity;
+    snap->game.monsterManager.cells = NULL;
+    memcpy(itemActive, game->itemActive, itemCount);
+    if (deathCount > 0) memcpy(deaths, game->deathManager.deaths, sizeof(MonsterDeath) * deathCount);
+    if (monsterCount > 0) memcpy(monsters, game->monsterManager.monsters, sizeof(Monster) * monsterCount);
+    BindProjectileArrays(&snap->game.projectiles, snap->shotData, snap->shotCapacity);
+    CopyProjectiles(&snap->game.projectiles, &game->projectiles);
+    // O mapa do cache pode ser trocado enquanto a thread grava: a cópia leva
+    // só os campos escalares, que é o que o save usa
+    snap->map = *game->map;
+    snap->map.terrain = NULL;
+    snap->map.items = NULL;
+    snap->map.monsters = NULL;
+    snap->game.map = &snap->map;
+    snap->player = *player;
+    FillSlotInfo(&saver->pendingInfo, game, player);
+
+    pthread_mutex_lock(&saver->lock);
+    saver->jobIndex = saver->fillIndex;
+    saver->busy = true;
+    saver->saving = true;
+    RecordFlightEvent(&flightRecorder, "autosave iniciado");
+    pthread_cond_signal(&saver->wake);
+    pthread_mutex_unlock(&saver->lock);
+
+    saver->fillIndex = 1 - saver->fillIndex;
+}
+
+void DrawAutoSaveToast(const AutoSaver *saver) {
+    const char *text = NULL;
+    Color color = GREEN;
+
+    if (saver->saving) {
+        text = "Salvando...";
+        color = LIGHTGRAY;
+    } else if (saver->toastTime > 0) {
+        text = saver->toastOk ? "Jogo salvo automaticamente" : "Falha no autosave";
+        color = saver->toastOk ? GREEN : RED;
+    }
+    if (!text) return;
+
+    int width = MeasureText(text, 20);
+    DrawRectangle(SCREENWIDTH - width - 30, HUD_HEIGHT + 10, width + 20, 30, Fade(BLACK, 0.6f));
+    DrawText(text, SCREENWIDTH - width - 20, HUD_HEIGHT + 15, 20, color);
+}
+
+void *AutoSaveWorker(void *arg) {
+    AutoSaver *saver = arg;
+    ByteWriter writer = {0};
+    char filename[64];
+    GetSlotFilename(AUTOSAVE_SLOT, filename, sizeof(filename));
 
-        DrawText("Parabens! Todas as fases concluidas!", 300, SCREENHEIGHT / 2, 40, YELLOW);
-        DrawText(TextFormat("Pontuacao final: %d", player.score), 300, SCREENHEIGHT / 2 + 60, 30, WHITE);
+    pthread_mutex_lock(&saver->lock);
+    while (true) {
+        while (saver->jobIndex == -1 && !saver->quit) pthread_cond_wait(&saver->wake, &saver->lock);
+        if (saver->jobIndex == -1) break;
 
-        if (topPosition != -1) {
-            char msg[100];
-            snprintf(msg, sizeof(msg), "Com essa pontuacao voce ficou no top %d!", topPosition + 1);
-            DrawText(msg, 300, SCREENHEIGHT / 2 + 120, 30, GREEN);
-        }
+        SaveSnapshot *snap = &saver->snapshots[saver->jobIndex];
+        saver->jobIndex = -1;
+        pthread_mutex_unlock(&saver->lock);
 
-        DrawText("Pressione ENTER para continuar...", 300, SCREENHEIGHT / 2 + 200, 20, GRAY);
-        EndDrawing();
+        writer.size = 0;
+        EncodeGameState(&writer, &snap->game, &snap->player);
+        bool ok = WriteFileAtomic(filename, writer.data, writer.size);
 
-        if (IsKeyPressed(KEY_ENTER)) waiting = false;
+        pthread_mutex_lock(&saver->lock);
+        saver->lastResult = ok;
+        saver->finished = true;
+        saver->busy = false;
     }
+    pthread_mutex_unlock(&saver->lock);
+
+    FreeByteWriter(&writer);
+    return NULL;
 }
 
-int UpdateHighScores(HighScore scores[MAX_SCORES], const char *filename, int newScore) {
-    int pos = CheckHighScorePosition(scores, newScore);
-    if (pos == -1) return -1;
+Scene MessageScene(const char *text, Color background, Color color, int fontSize, float duration, MessageAction action) {
+    Scene scene = { .name = "mensagem", .update = UpdateMessageScene, .draw = DrawMessageScene };
+    strncpy(scene.state.message.text, text, sizeof(scene.state.message.text) - 1);
+    scene.state.message.background = background;
+    scene.state.message.color = color;
+    scene.state.message.fontSize = fontSize;
+    scene.state.message.remaining = duration;
+    scene.state.message.action = action;
+    return scene;
+}
 
-    for (int i = MAX_SCORES - 1; i > pos; i--) {
-        scores[i] = scores[i - 1];
-    }
+// Mensagem temporizada; a janela segue respondendo enquanto ela aparece
+void UpdateMessageScene(Scene *scene, App *app) {
+    scene->state.message.remaining -= GetFrameTime();
+    if (scene->state.message.remaining > 0) return;
 
-    char name[NAME_LENGTH] = {0};
-    bool nameEntered = false;
-    int letterCount = 0;
+    MessageAction action = scene->state.message.action;
+    PopScene(app);
 
-    while (!nameEntered && !WindowShouldClose()) {
-        BeginDrawing();
-        ClearBackground(BLACK);
+    if (action == MESSAGE_NEXT_LEVEL) {
+        app->player.level++;
+        StartLevel(app);
+    }
+}
 
-        DrawText("NOVA PONTUACAO ALTA!", (SCREENWIDTH - MeasureText("NOVA PONTUACAO ALTA!", 40)) / 2, 200, 40, YELLOW);
-        DrawText(TextFormat("Posicao: %d", pos + 1), (SCREENWIDTH - MeasureText(TextFormat("Posicao: %d", pos + 1), 30)) / 2, 250, 30, WHITE);
-        DrawText("Digite seu nome:", (SCREENWIDTH - MeasureText("Digite seu nome:", 30)) / 2, 300, 30, WHITE);
+void DrawMessageScene(const Scene *scene, const App *app) {
+    (void)app;
+    const char *text = scene->state.message.text;
+    int fontSize = scene->state.message.fontSize;
 
-        // Desenha o retângulo do input
-        Rectangle textBox = { (SCREENWIDTH - 300) / 2, 350, 300, 40 };
-        DrawRectangleRec(textBox, LIGHTGRAY);
-        DrawRectangleLinesEx(textBox, 2, DARKGRAY);
-        DrawText(name, textBox.x + 5, textBox.y + 10, 20, MAROON);
+    ClearBackground(scene->state.message.background);
+    DrawText(text, (SCREENWIDTH - MeasureText(text, fontSize)) / 2, SCREENHEIGHT / 2, fontSize, scene->state.message.color);
+}
 
-        // Verifica entrada de teclado
-        int key = GetCharPressed();
-        while (key > 0) {
-            if ((key >= 32) && (key <= 125) && (letterCount < NAME_LENGTH - 1)) {
-                name[letterCount] = (char)key;
-                name[letterCount + 1] = '\0';
-                letterCount++;
-            }
-            key = GetCharPressed();
+// Captura o resumo do slot no momento do save: a miniatura é a janela de
+// THUMB_WIDTH x THUMB_HEIGHT tiles ao redor do jogador
+void FillSlotInfo(SlotInfo *info, const GameSession *game, const Player *player) {
+    memset(info, 0, sizeof(*info));
+    info->used = true;
+    info->hasPreview = true;
+    info->level = player->level;
+    info->score = player->score;
+    info->lives = player->lives;
+    info->playTime = (int)player->playTime;
+    info->savedAt = (int64_t)time(NULL);
+    snprintf(info->mapFile, sizeof(info->mapFile), "%s", game->mapFile);
+
+    const Map *map = game->map;
+    int top = player->row - THUMB_HEIGHT / 2;
+    int left = player->col - THUMB_WIDTH / 2;
+    if (top > map->rows - THUMB_HEIGHT) top = map->rows - THUMB_HEIGHT;
+    if (left > map->cols - THUMB_WIDTH) left = map->cols - THUMB_WIDTH;
+    if (top < 0) top = 0;
+    if (left < 0) left = 0;
+
+    for (int r = 0; r < THUMB_HEIGHT; r++) {
+        for (int c = 0; c < THUMB_WIDTH; c++) {
+            bool inside = top + r < map->rows && left + c < map->cols;
+            info->thumbnail[r * THUMB_WIDTH + c] = inside ? TERRAIN_AT(map, top + r, left + c) : '\0';
         }
+    }
 
-        if (IsKeyPressed(KEY_BACKSPACE)) {
-            letterCount--;
-            if (letterCount < 0) letterCount = 0;
-            name[letterCount] = '\0';
+    // Entidades por cima do terreno, na mesma prioridade do DrawMap
+    for (int i = 0; i < map->itemCount; i++) {
+        const Item *item = &map->items[i];
+        int r = item->row - top, c = item->col - left;
+        if (game->itemActive[i] && r >= 0 && r < THUMB_HEIGHT && c >= 0 && c < THUMB_WIDTH) {
+            info->thumbnail[r * THUMB_WIDTH + c] = item->type;
         }
+    }
+    for (int i = 0; i < game->monsterManager.count; i++) {
+        const Monster *m = &game->monsterManager.monsters[i];
+        int r = m->row - top, c = m->col - left;
+        if (m->active && r >= 0 && r < THUMB_HEIGHT && c >= 0 && c < THUMB_WIDTH) info->thumbnail[r * THUMB_WIDTH + c] = 'M';
+    }
+    if (player->row - top < THUMB_HEIGHT && player->col - left < THUMB_WIDTH) {
+        info->thumbnail[(player->row - top) * THUMB_WIDTH + (player->col - left)] = 'J';
+    }
+}
 
-        if (IsKeyPressed(KEY_ENTER) && letterCount > 0) {
-            nameEntered = true;
-        }
+// Índice versão 1: cabeçalho "ZSLT" (ver SealPayload)
+//   payload: quantidade de slots usados | por slot: número, flags, fase, pontuação,
+//            vidas, tempo de jogo, data, mapa e miniatura
+bool LoadSlotIndex(SlotIndex *index) {
+    memset(index, 0, sizeof(*index));
 
-        EndDrawing();
+    int size = 0;
+    unsigned char *data = LoadFileData(SLOT_INDEX_FILE, &size);
+    if (!data) return false;
+
+    ByteReader r;
+    if (!OpenPayload(data, (size_t)size, SLOT_INDEX_MAGIC, SLOT_INDEX_VERSION, &r)) {
+        UnloadFileData(data);
+        return false;
     }
 
-    strncpy(scores[pos].name, name, NAME_LENGTH - 1);
-    scores[pos].score = newScore;
+    uint64_t count = ReadVarU(&r);
+    for (uint64_t i = 0; i < count && !r.error; i++) {
+        uint64_t slot = ReadVarU(&r);
+        if (slot > MAX_SAVE_SLOTS) {
+            r.error = true;
+            break;
+        }
+        SlotInfo *info = &index->slots[slot];
+        info->used = true;
+        info->hasPreview = ReadVarU(&r) != 0;
+        info->level = (int)ReadVarI(&r);
+        info->score = (int)ReadVarI(&r);
+        info->lives = (int)ReadVarI(&r);
+        info->playTime = (int)ReadVarU(&r);
+        info->savedAt = ReadVarI(&r);
+        size_t nameLength = ReadVarU(&r);
+        if (nameLength >= MAP_NAME_LENGTH) {
+            r.error = true;
+            break;
+        }
+        ReadBytes(&r, info->mapFile, nameLength);
+        if (info->hasPreview) ReadBytes(&r, info->thumbnail, sizeof(info->thumbnail));
+    }
 
-    SaveHighScores(scores, filename);
-    return pos;
+    UnloadFileData(data);
+    if (r.error) memset(index, 0, sizeof(*index));
+    return !r.error;
 }
 
-void SaveHighScores(HighScore scores[MAX_SCORES], const char *filename) {
-    FILE *file = fopen(filename, "wb");
-    if (!file) {
-        fprintf(stderr, "Erro ao salvar o arquivo de pontuacoes.\n");
-        return;
+bool SaveSlotIndex(const SlotIndex *index) {
+    ByteWriter writer = {0};
+    unsigned char header[SAVE_HEADER_SIZE] = {0};
+    WriteBytes(&writer, header, SAVE_HEADER_SIZE);
+
+    uint64_t count = 0;
+    for (int slot = 0; slot <= MAX_SAVE_SLOTS; slot++) count += index->slots[slot].used;
+    WriteVarU(&writer, count);
+
+    for (int slot = 0; slot <= MAX_SAVE_SLOTS; slot++) {
+        const SlotInfo *info = &index->slots[slot];
+        if (!info->used) continue;
+        WriteVarU(&writer, slot);
+        WriteVarU(&writer, info->hasPreview ? 1 : 0);
+        WriteVarI(&writer, info->level);
+        WriteVarI(&writer, info->score);
+        WriteVarI(&writer, info->lives);
+        WriteVarU(&writer, info->playTime);
+        WriteVarI(&writer, info->savedAt);
+        size_t nameLength = strlen(info->mapFile);
+        WriteVarU(&writer, nameLength);
+        WriteBytes(&writer, info->mapFile, nameLength);
+        if (info->hasPreview) WriteBytes(&writer, info->thumbnail, sizeof(info->thumbnail));
     }
-    fwrite(scores, sizeof(HighScore), MAX_SCORES, file);
-    fclose(file);
+
+    SealPayload(&writer, SLOT_INDEX_MAGIC, SLOT_INDEX_VERSION);
+    bool success = WriteFileAtomic(SLOT_INDEX_FILE, writer.data, writer.size);
+    FreeByteWriter(&writer);
+
+    if (!success) fprintf(stderr, "Erro ao salvar o indice de slots.\n");
+    return success;
 }
 
-bool RunGame(const char *mapFile, Player *player) {
-    char map[ROWS][COLS];
-    LoadMapFromFile(map, mapFile);
+// Sem índice (saves de versões anteriores): uma única varredura do diretório
+// marca os slots existentes, que aparecem sem prévia até serem regravados
+void RebuildSlotIndex(SlotIndex *index) {
+    memset(index, 0, sizeof(*index));
+
+    DIR *dir = opendir("saves");
+    if (!dir) return;
+
+    bool found = false;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int slot = -1, length = 0;
+        if (strcmp(entry->d_name, "autosave.bin") == 0) slot = AUTOSAVE_SLOT;
+        else if (sscanf(entry->d_name, "save_slot%d.bin%n", &slot, &length) != 1 || length == 0 || entry->d_name[length] != '\0') continue;
+        if (slot < 0 || slot > MAX_SAVE_SLOTS) continue;
+        index->slots[slot].used = true;
+        found = true;
+    }
+    closedir(dir);
 
-    LocatePlayer(map, player);
+    if (found) SaveSlotIndex(index);
+}
 
-    AttackEffect attackEffect = {0};
-    MonsterDeathManager deathManager = {0};
-    MonsterManager monsterManager = {0};
-    InitializeMonsters(map, &monsterManager);
+void DrawSlotThumbnail(const SlotInfo *info, int x, int y) {
+    for (int r = 0; r < THUMB_HEIGHT; r++) {
+        for (int c = 0; c < THUMB_WIDTH; c++) {
+            Color color;
+            switch (info->thumbnail[r * THUMB_WIDTH + c]) {
+                case 'P': color = GRAY; break;
+                case 'J': color = BLUE; break;
+                case 'M': color = RED; break;
+                case 'V': color = GREEN; break;
+                case 'T': color = SKYBLUE; break;
+                case ' ': color = RAYWHITE; break;
+                case '\0': continue;
+                default: {
+                    int weapon = AttackKindForItem(info->thumbnail[r * THUMB_WIDTH + c]);
+                    color = weapon >= 0 ? attackDefs[weapon].color : LIGHTGRAY;
+                    break;
+                }
+            }
+            DrawRectangle(x + c * THUMB_CELL, y + r * THUMB_CELL, THUMB_CELL, THUMB_CELL, color);
+        }
+    }
+}
 
-    int frameCount = 0;
-    bool gameRunning = true;
-    int monsterMoveCounter = 0;
+// Itens, jogador, contagem e vetor inteiro de monstros (do tamanho do mapa),
+// efeito, contadores e o bloco de projéteis
+size_t RewindStateSize(const Map *map) {
+    return (size_t)map->itemCount + sizeof(Player) + sizeof(int32_t) + sizeof(Monster) * map->monsterCount
+         + sizeof(AttackEffect) + 4 * sizeof(uint32_t) + sizeof(int32_t) + ProjectileArraysBytes(PROJECTILE_CAPACITY);
+}
 
-    while (!WindowShouldClose() && gameRunning) {
-        frameCount++;
-        monsterMoveCounter++;
+// Pior caso do EncodeXorRle: pares separados por pelo menos 4 bytes iguais,
+// cada um com dois varints, ficam abaixo de 2x o estado para qualquer
+// tamanho realista (os varints só passam de 4 bytes acima de 256 MB)
+size_t RewindDeltaBound(size_t stateSize) {
+    return 2 * stateSize + 32;
+}
 
-        UpdatePlayer(map, player);
+size_t RewindPoolSize(size_t stateSize) {
+    size_t minimum = 4 * RewindDeltaBound(stateSize);
+    return minimum > REWIND_POOL_SIZE ? minimum : REWIND_POOL_SIZE;
+}
 
-        if (monsterMoveCounter >= MONSTER_MOVE_INTERVAL) {
-            UpdateMonsters(map, &monsterManager, player);
-            monsterMoveCounter = 0;
-        }
+// Prepara o anel para a fase com memória da arena da fase
+void ResetRewind(RewindBuffer *rewind, Arena *arena, const Map *map) {
+    memset(rewind, 0, sizeof(*rewind));
+    rewind->stateSize = RewindStateSize(map);
+    rewind->poolSize = RewindPoolSize(rewind->stateSize);
+    rewind->base = ArenaAlloc(arena, rewind->stateSize, MEM_REWIND);
+    rewind->key = ArenaAlloc(arena, rewind->stateSize, MEM_REWIND);
+    rewind->pool = ArenaAlloc(arena, rewind->poolSize, MEM_REWIND);
+    rewind->entries = ArenaAlloc(arena, sizeof(RewindEntry) * REWIND_CAPACITY, MEM_REWIND);
+    if (!rewind->base || !rewind->key || !rewind->pool || !rewind->entries) {
+        memset(rewind, 0, sizeof(*rewind));
+        return;
+    }
+    rewind->capacity = REWIND_CAPACITY;
+}
 
-        BeginDrawing();
-        ClearBackground(RAYWHITE);
+// Esquece todo o histórico; o próximo tick gravado vira o primeiro keyframe
+void ClearRewind(RewindBuffer *rewind) {
+    for (int i = 0; i < rewind->capacity; i++) rewind->entries[i].size = 0;
+    rewind->start = rewind->count = rewind->latestKey = 0;
+    rewind->head = rewind->tail = 0;
+    rewind->bytesUsed = 0;
+}
 
-        DrawHUD(player);
-        DrawMap(map, player, frameCount);
+// Procura "size" bytes contíguos depois do diff mais recente, dando a volta
+// no anel se preciso. Retorna SIZE_MAX quando só cabe descartando histórico
+size_t ReserveRewindBytes(RewindBuffer *rewind, size_t size) {
+    if (rewind->bytesUsed == 0) rewind->head = rewind->tail = 0;
 
-        if (attackEffect.active) {
-            for (int i = 0; i < 3; i++) {
-                int tx = attackEffect.tiles[i].x;
-                int ty = attackEffect.tiles[i].y;
-                if (tx >= 0 && tx < COLS && ty >= 0 && ty < ROWS) {
-                    Rectangle area = {tx * TILE_SIZE, ty * TILE_SIZE + HUD_HEIGHT, TILE_SIZE, TILE_SIZE};
-                    DrawRectangleRec(area, Fade(GOLD, 0.5f));
-                }
-            }
-            if (--attackEffect.frameCounter <= 0) attackEffect.active = 0;
-        }
+    if (rewind->tail >= rewind->head) {
+        if (rewind->poolSize - rewind->tail >= size) return rewind->tail;
+        if (size < rewind->head) return 0;
+    } else if (rewind->head - rewind->tail > size) {
+        return rewind->tail;
+    }
+    return SIZE_MAX;
+}
 
-        DrawMonsterDeaths(&deathManager);
-        DrawText("WASD para mover | J para atacar | TAB para pausar | ESC para sair", 700, SCREENHEIGHT-30, 20, DARKGRAY);
+void CaptureRewindState(const GameSession *game, const Player *player, unsigned char *out) {
+    size_t itemCount = (size_t)game->map->itemCount;
+    uint32_t counters[4] = { (uint32_t)game->frameCount, (uint32_t)game->ai.cursor, (uint32_t)game->ai.backlog, game->rng.state };
+
+    memcpy(out, game->itemActive, itemCount);
+    out += itemCount;
+    memcpy(out, player, sizeof(Player));
+    out += sizeof(Player);
+    int32_t monsterCount = game->monsterManager.count;
+    memcpy(out, &monsterCount, sizeof(monsterCount));
+    out += sizeof(monsterCount);
+    memcpy(out, game->monsterManager.monsters, sizeof(Monster) * game->monsterManager.capacity);
+    out += sizeof(Monster) * game->monsterManager.capacity;
+    memcpy(out, &game->attackEffect, sizeof(AttackEffect));
+    out += sizeof(AttackEffect);
+    memcpy(out, counters, sizeof(counters));
+    out += sizeof(counters);
+
+    // O bloco inteiro do pool: a parte que não mudou some no diff XOR
+    int32_t shotCount = game->projectiles.count;
+    memcpy(out, &shotCount, sizeof(shotCount));
+    out += sizeof(shotCount);
+    memcpy(out, game->projectiles.x, ProjectileArraysBytes(PROJECTILE_CAPACITY));
+}
 
-        bool allDefeated = true;
-        for (int i = 0; i < monsterManager.count; i++) {
-            if (monsterManager.monsters[i].active) {
-                allDefeated = false;
-                break;
-            }
+void RestoreRewindState(GameSession *game, Player *player, const unsigned char *in) {
+    size_t itemCount = (size_t)game->map->itemCount;
+    uint32_t counters[4];
+
+    memcpy(game->itemActive, in, itemCount);
+    game->itemHash = HashItemLayer(game);
+    in += itemCount;
+    memcpy(player, in, sizeof(Player));
+    in += sizeof(Player);
+    int32_t monsterCount;
+    memcpy(&monsterCount, in, sizeof(monsterCount));
+    in += sizeof(monsterCount);
+    game->monsterManager.count = monsterCount;
+    memcpy(game->monsterManager.monsters, in, sizeof(Monster) * game->monsterManager.capacity);
+    in += sizeof(Monster) * game->monsterManager.capacity;
+    RebuildMonsterCells(&game->monsterManager);
+    memcpy(&game->attackEffect, in, sizeof(AttackEffect));
+    in += sizeof(AttackEffect);
+    memcpy(counters, in, sizeof(counters));
+    in += sizeof(counters);
+    int32_t shotCount;
+    memcpy(&shotCount, in, sizeof(shotCount));
+    in += sizeof(shotCount);
+    memcpy(game->projectiles.x, in, ProjectileArraysBytes(PROJECTILE_CAPACITY));
+    game->projectiles.count = shotCount;
+
+    game->frameCount = (int)counters[0];
+    game->ai.cursor = (int)counters[1];
+    game->ai.backlog = (int)counters[2];
+    game->rng.state = counters[3];
+    // Animações de morte são só visuais e não entram no histórico
+    game->deathManager.count = 0;
+}
+
+// Diff a ^ b como pares (zeros pulados, bytes literais) em varint: um tick em
+// que só o jogador andou vira poucas dezenas de bytes, qualquer que seja o mapa
+void EncodeXorRle(ByteWriter *w, const unsigned char *a, const unsigned char *b, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
+        size_t skip = pos;
+        while (skip < size && a[skip] == b[skip]) skip++;
+        if (skip == size) break;
+
+        // Literais vão até aparecerem 4 bytes iguais seguidos (abaixo disso um novo par custa mais)
+        size_t end = skip;
+        size_t equalRun = 0;
+        while (end < size && equalRun < 4) {
+            equalRun = (a[end] == b[end]) ? equalRun + 1 : 0;
+            end++;
         }
+        end -= equalRun;
 
-        if (allDefeated) {
-            BeginDrawing();
-            ClearBackground(RAYWHITE);
-            DrawText("Fase concluida!", (SCREENWIDTH - MeasureText("Fase concluida!", 60)) / 2, SCREENHEIGHT / 2, 60, GREEN);
-            EndDrawing();
-            WaitTime(2.0);
-            return true;
+        WriteVarU(w, skip - pos);
+        WriteVarU(w, end - skip);
+        for (size_t i = skip; i < end; i++) {
+            unsigned char x = a[i] ^ b[i];
+            WriteBytes(w, &x, 1);
         }
+        pos = end;
+    }
+}
 
-        EndDrawing();
+// XOR é a própria inversa: o mesmo diff leva de b para a e de a para b
+void ApplyXorRle(unsigned char *state, const unsigned char *delta, size_t size) {
+    ByteReader r = { delta, size, 0, false };
+    size_t pos = 0;
+    while (r.pos < r.size && !r.error) {
+        pos += ReadVarU(&r);
+        size_t literals = ReadVarU(&r);
+        if (r.pos + literals > r.size) break;
+        for (size_t i = 0; i < literals; i++) state[pos++] ^= r.data[r.pos++];
+    }
+}
 
-        if (IsKeyPressed(KEY_TAB)) {
-            PauseAction action = ShowPauseMenu();
-            switch (action) {
-                case PAUSE_CONTINUE:
-                    break;
-                case PAUSE_SAVE: {
-                    int slot = ChooseSaveSlot("Escolha um slot para SALVAR");
-                    if (slot != -1) {
-                        SaveGameSlot(player, slot);
-                    }
-                    break;
-                }
-                case PAUSE_RETURN_MENU:
-                    return false;
-                case PAUSE_EXIT_GAME:
-                    CloseWindow();
-                    exit(0);
-            }
-        }
+// O estado do tick é montado num buffer da arena do frame; o diff é escrito
+// direto no anel, com espaço reservado para o pior caso
+void RecordRewind(RewindBuffer *rewind, const GameSession *game, const Player *player, Arena *frame) {
+    if (!rewind->entries) return;
+    unsigned char *state = ArenaAlloc(frame, rewind->stateSize, MEM_REWIND);
+    if (!state) return;
+    CaptureRewindState(game, player, state);
+
+    if (rewind->count == rewind->capacity) DropOldestRewindGroup(rewind);
+
+    size_t bound = RewindDeltaBound(rewind->stateSize);
+    size_t offset = ReserveRewindBytes(rewind, bound);
+    while (offset == SIZE_MAX) {
+        // Um único grupo maior que o anel: recomeça o histórico deste tick
+        if (!DropOldestRewindGroup(rewind)) ClearRewind(rewind);
+        offset = ReserveRewindBytes(rewind, bound);
+    }
 
-        if (IsKeyPressed(KEY_ESCAPE)) return false;
-        if (player->isBlinking && --player->blinkFrames <= 0) player->isBlinking = false;
-        if (IsKeyPressed(KEY_J)) PerformSwordAttack(map, player, &attackEffect, &deathManager, &monsterManager);
+    RewindEntry *entry = &rewind->entries[(rewind->start + rewind->count) % rewind->capacity];
+    entry->offset = offset;
+    entry->size = 0;
+
+    if (rewind->count == 0) {
+        // Primeiro keyframe: fica inteiro em base/key e não precisa de diff
+        memcpy(rewind->base, state, rewind->stateSize);
+        memcpy(rewind->key, state, rewind->stateSize);
+        entry->keyframe = true;
+        rewind->latestKey = 0;
+    } else {
+        entry->keyframe = (rewind->count - rewind->latestKey) >= REWIND_KEYFRAME_INTERVAL;
+        // Com capacidade = pior caso o WriteBytes nunca realoca o anel
+        ByteWriter delta = { rewind->pool + offset, 0, bound };
+        EncodeXorRle(&delta, state, rewind->key, rewind->stateSize);
+        entry->size = delta.size;
+        if (entry->keyframe) {
+            memcpy(rewind->key, state, rewind->stateSize);
+            rewind->latestKey = rewind->count;
+        }
     }
 
-    return false;
+    if (entry->size > 0) rewind->tail = offset + entry->size;
+    rewind->bytesUsed += entry->size;
+    rewind->count++;
 }
 
-void LoadMapFromFile(char map[ROWS][COLS], const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Erro ao abrir o arquivo %s\n", filename);
-        exit(1);
+// Descarta o grupo mais antigo (keyframe + ticks que dependem dele) e avança
+// a base para o keyframe seguinte. Retorna false se só resta um grupo
+bool DropOldestRewindGroup(RewindBuffer *rewind) {
+    int next = 1;
+    while (next < rewind->count && !rewind->entries[(rewind->start + next) % rewind->capacity].keyframe) next++;
+    if (next >= rewind->count) return false;
+
+    RewindEntry *nextKey = &rewind->entries[(rewind->start + next) % rewind->capacity];
+    ApplyXorRle(rewind->base, rewind->pool + nextKey->offset, nextKey->size);
+    rewind->bytesUsed -= nextKey->size;
+    nextKey->size = 0;
+
+    for (int i = 0; i < next; i++) {
+        RewindEntry *entry = &rewind->entries[(rewind->start + i) % rewind->capacity];
+        rewind->bytesUsed -= entry->size;
+        entry->size = 0;
     }
-
-    char line[COLS + 2];
-    for (int row = 0; row < ROWS && fgets(line, sizeof(line), file); row++) {
-        for (int col = 0; col < COLS; col++) {
-            map[row][col] = line[col];
+    rewind->start = (rewind->start + next) % rewind->capacity;
+    rewind->count -= next;
+    rewind->latestKey -= next;
+
+    // O começo do anel passa a ser o primeiro diff que sobrou
+    for (int i = 0; i < rewind->count && rewind->bytesUsed > 0; i++) {
+        const RewindEntry *entry = &rewind->entries[(rewind->start + i) % rewind->capacity];
+        if (entry->size > 0) {
+            rewind->head = entry->offset;
+            break;
         }
     }
-    fclose(file);
+    return true;
 }
 
-void LocatePlayer(char map[ROWS][COLS], Player *player) {
-    player->swordActive = false;
-    player->isBlinking = false;
-    player->blinkFrames = 0;
-    player->facingRow = 0;
-    player->facingCol = 1;
+// Volta um tick: descarta o mais recente e restaura o anterior a partir do
+// keyframe do grupo. Retorna false quando o histórico acabou
+bool StepRewind(RewindBuffer *rewind, GameSession *game, Player *player, Arena *frame) {
+    if (!rewind->entries || rewind->count <= 1) return false;
+    unsigned char *state = ArenaAlloc(frame, rewind->stateSize, MEM_REWIND);
+    if (!state) return false;
+
+    int last = rewind->count - 1;
+    RewindEntry *entry = &rewind->entries[(rewind->start + last) % rewind->capacity];
+    if (entry->keyframe) {
+        // key volta para o keyframe anterior desfazendo o diff entre os dois
+        ApplyXorRle(rewind->key, rewind->pool + entry->offset, entry->size);
+        do {
+            rewind->latestKey--;
+        } while (rewind->latestKey > 0 && !rewind->entries[(rewind->start + rewind->latestKey) % rewind->capacity].keyframe);
+    }
+    if (entry->size > 0) rewind->tail = entry->offset;
+    rewind->bytesUsed -= entry->size;
+    entry->size = 0;
+    rewind->count--;
+
+    const RewindEntry *previous = &rewind->entries[(rewind->start + rewind->count - 1) % rewind->capacity];
+    memcpy(state, rewind->key, rewind->stateSize);
+    if (!previous->keyframe) ApplyXorRle(state, rewind->pool + previous->offset, previous->size);
+    RestoreRewindState(game, player, state);
+    return true;
+}
 
-    for (int i = 0; i < ROWS; i++) {
-        for (int j = 0; j < COLS; j++) {
-            if (map[i][j] == 'J') {
-                player->row = i;
-                player->col = j;
-                return;
-            }
+// Esvazia a fila do raylib na ordem de chegada e anota as direções
+// seguradas, que movem o jogador em todo tick enquanto durarem. O raylib
+// não informa quando cada tecla foi pressionada, então o carimbo é o
+// início do frame: a latência medida é a parte que o jogo controla
+void PollInput(InputQueue *input) {
+    static const int actionKeys[INPUT_ACTION_COUNT] = {
+        [INPUT_MOVE_UP] = KEY_W, [INPUT_MOVE_DOWN] = KEY_S, [INPUT_MOVE_LEFT] = KEY_A,
+        [INPUT_MOVE_RIGHT] = KEY_D, [INPUT_ATTACK] = KEY_J, [INPUT_THROW] = KEY_K, [INPUT_PAUSE] = KEY_TAB, [INPUT_EXIT] = KEY_ESCAPE
+    };
+    double now = GetTime();
+    input->count = 0;
+
+    if (IsKeyPressed(KEY_F3)) input->showLatency = !input->showLatency;
+
+    int key;
+    while ((key = GetKeyPressed()) != 0) {
+        for (int action = 0; action < INPUT_ACTION_COUNT; action++) {
+            if (actionKeys[action] != key) continue;
+            PushInputEvent(input, action, now);
         }
     }
+
+    for (int action = 0; action <= INPUT_MOVE_RIGHT; action++) {
+        input->held[action] = IsKeyDown(actionKeys[action]);
+    }
 }
 
-void UpdatePlayer(char map[ROWS][COLS], Player *player) {
-    int dirRow = 0, dirCol = 0;
-    if (IsKeyPressed(KEY_W)) { dirRow = -1; player->facingRow = -1; player->facingCol = 0; }
-    else if (IsKeyPressed(KEY_S)) { dirRow = 1; player->facingRow = 1; player->facingCol = 0; }
-    else if (IsKeyPressed(KEY_A)) { dirCol = -1; player->facingRow = 0; player->facingCol = -1; }
-    else if (IsKeyPressed(KEY_D)) { dirCol = 1; player->facingRow = 0; player->facingCol = 1; }
+void PushInputEvent(InputQueue *input, InputAction action, double time) {
+    if (input->count == MAX_INPUT_EVENTS) return;
+    input->events[input->count++] = (InputEvent){ action, time };
+}
 
-    int newRow = player->row + dirRow;
-    int newCol = player->col + dirCol;
+void MarkInputApplied(InputQueue *input, const InputEvent *event) {
+    if (input->appliedTime == 0 || event->time < input->appliedTime) input->appliedTime = event->time;
+}
 
-    if ((dirRow || dirCol) &&
-        newRow >= 0 && newRow < ROWS && newCol >= 0 && newCol < COLS &&
-        map[newRow][newCol] != 'P') {
+// Chamado logo após o EndDrawing: o frame com a entrada acabou de ser apresentado
+void RecordInputLatency(InputQueue *input, double presentTime) {
+    if (input->appliedTime == 0) return;
 
-        char target = map[newRow][newCol];
+    input->latency[input->latencyNext] = (float)((presentTime - input->appliedTime) * 1000.0);
+    input->latencyNext = (input->latencyNext + 1) % LATENCY_HISTORY;
+    if (input->latencyCount < LATENCY_HISTORY) input->latencyCount++;
+    input->appliedTime = 0;
+}
 
-    if (target == 'M') {
-        if (!player->isBlinking) {
-            player->lives--;
-            player->isBlinking = true;
-            player->blinkFrames = 30;
-        }
-        map[player->row][player->col] = ' ';
-        map[newRow][newCol] = 'J';
-        player->row = newRow;
-        player->col = newCol;
+// F3: latência entrada -> present dos últimos frames com entrada
+void DrawInputLatency(const InputQueue *input) {
+    if (input->latencyCount == 0) {
+        DrawText("Latencia: sem entrada", 20, SCREENHEIGHT - 60, 20, MAROON);
         return;
     }
 
-    if (target == 'V') {
-        player->lives++;
-        player->score += LIFE_SCORE;
-    } else if (target == 'E') {
-        player->score += SWORD_SCORE;
-        player->swordActive = true;
+    float total = 0, worst = 0;
+    for (int i = 0; i < input->latencyCount; i++) {
+        total += input->latency[i];
+        if (input->latency[i] > worst) worst = input->latency[i];
+    }
+    int last = (input->latencyNext + LATENCY_HISTORY - 1) % LATENCY_HISTORY;
+    DrawText(TextFormat("Latencia (ms)  ultima %.1f  media %.1f  max %.1f", input->latency[last], total / input->latencyCount, worst),
+             20, SCREENHEIGHT - 60, 20, MAROON);
+
+    for (int i = 0; i < input->latencyCount; i++) {
+        int index = (input->latencyNext - input->latencyCount + i + LATENCY_HISTORY) % LATENCY_HISTORY;
+        int height = (int)input->latency[index];
+        if (height > 60) height = 60;
+        DrawRectangle(20 + i * 3, SCREENHEIGHT - 70 - height, 2, height, Fade(MAROON, 0.6f));
     }
+}
 
-    map[player->row][player->col] = ' ';
-    map[newRow][newCol] = 'J';
-    player->row = newRow;
-    player->col = newCol;
-        }
+void InitTelemetry(TelemetryWriter *writer, bool enabled) {
+    memset(writer, 0, sizeof(*writer));
+    writer->jobIndex = -1;
+    writer->enabled = enabled;
+    if (!enabled) return;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->wake, NULL);
+    pthread_create(&writer->thread, NULL, TelemetryWorker, writer);
 }
 
-void DrawHUD(const Player *player) {
-    DrawRectangle(0, 0, SCREENWIDTH, HUD_HEIGHT, DARKGRAY);
-    DrawText(TextFormat("Pontuacao: %d", player->score), 20, 20, 20, WHITE);
-    DrawText(TextFormat("Vidas: %d", player->lives), 300, 20, 20, WHITE);
-    DrawText(TextFormat("Nivel: %d", player->level), 550, 20, 20, WHITE);
+// A thread grava o lote incompleto antes de sair
+void ShutdownTelemetry(TelemetryWriter *writer) {
+    if (!writer->enabled) return;
+    pthread_mutex_lock(&writer->lock);
+    writer->quit = true;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    pthread_cond_destroy(&writer->wake);
+    pthread_mutex_destroy(&writer->lock);
+    writer->enabled = false;
+}
 
-    if (player->swordActive) {
-        DrawText("ESPADA ATIVA", 800, 20, 20, GOLD);
+// Chamada de novo pelo DecodeGameState depois de aplicar o save, para a base
+// de comparação ser o estado carregado
+void BeginLevelTelemetry(LevelTelemetry *level, const GameSession *game, const Player *player, double loadTime) {
+    memset(level, 0, sizeof(*level));
+    level->active = true;
+    snprintf(level->mapFile, sizeof(level->mapFile), "%s", game->mapFile);
+    level->startedAt = (int64_t)time(NULL);
+    level->loadTime = loadTime;
+    level->startScore = level->score = player->score;
+    level->lives = player->lives;
+    level->monstersAlive = CountActiveMonsters(&game->monsterManager);
+}
+
+void RecordFrameTelemetry(LevelTelemetry *level, float deltaTime) {
+    // Limites superiores em ms; o último balde fica com o que passar de 50
+    static const float bucketLimits[TELEMETRY_BUCKETS - 1] = { 8, 12, 17, 20, 25, 33, 50 };
+    if (!level->active) return;
+
+    float ms = deltaTime * 1000.0f;
+    int bucket = 0;
+    while (bucket < TELEMETRY_BUCKETS - 1 && ms >= bucketLimits[bucket]) bucket++;
+    level->buckets[bucket]++;
+    level->duration += deltaTime;
+
+    // Piores frames em ordem decrescente
+    int slot = TELEMETRY_WORST_FRAMES;
+    while (slot > 0 && ms > level->worst[slot - 1].ms) slot--;
+    if (slot < TELEMETRY_WORST_FRAMES) {
+        memmove(&level->worst[slot + 1], &level->worst[slot], sizeof(FrameSample) * (TELEMETRY_WORST_FRAMES - 1 - slot));
+        level->worst[slot] = (FrameSample){ ms, level->frames };
     }
+    level->frames++;
 }
 
-void DrawMap(char map[ROWS][COLS], const Player *player, int frameCount) {
-    for (int i = 0; i < ROWS; i++) {
-        for (int j = 0; j < COLS; j++) {
-            Rectangle tile = {j * TILE_SIZE, i * TILE_SIZE + HUD_HEIGHT, TILE_SIZE, TILE_SIZE};
-            Color color;
-            switch (map[i][j]) {
-                case 'P': color = GRAY; break;
-                case 'J': color = (player->isBlinking && (frameCount / 5) % 2 == 0) ? BLANK :
-                    (player->swordActive ? DARKBLUE : BLUE); break;
-                case 'M': color = RED; break;
-                case 'V': color = GREEN; break;
-                case 'E': color = GOLD; break;
-                case ' ': color = RAYWHITE; break;
-                default: color = LIGHTGRAY; break;
-            }
-            DrawRectangleRec(tile, color);
-            DrawRectangleLinesEx(tile, 1, LIGHTGRAY);
+void UpdateLevelTelemetry(LevelTelemetry *level, const GameSession *game, const Player *player) {
+    if (!level->active) return;
+    int alive = CountActiveMonsters(&game->monsterManager);
+    if (player->lives < level->lives) level->livesLost += level->lives - player->lives;
+    if (alive < level->monstersAlive) level->monstersKilled += level->monstersAlive - alive;
+    level->lives = player->lives;
+    level->monstersAlive = alive;
+    level->score = player->score;
+}
+
+int CountActiveMonsters(const MonsterManager *monsterManager) {
+    int alive = 0;
+    for (int i = 0; i < monsterManager->count; i++) {
+        if (monsterManager->monsters[i].active) alive++;
+    }
+    return alive;
+}
+
+// Um objeto JSON por linha. Retorna o tamanho escrito, ou 0 se não coube
+int FormatLevelTelemetry(char *out, size_t size, const LevelTelemetry *level) {
+    char host[64] = "desconhecida";
+#if defined(_WIN32)
+    const char *computer = getenv("COMPUTERNAME");
+    if (computer) strncpy(host, computer, sizeof(host) - 1);
+#else
+    if (gethostname(host, sizeof(host)) != 0) strcpy(host, "desconhecida");
+    host[sizeof(host) - 1] = '\0';
+#endif
+    // Nomes vêm de arquivos e do sistema: aspas e controles não entram no JSON
+    char mapFile[MAP_NAME_LENGTH];
+    memcpy(mapFile, level->mapFile, sizeof(mapFile));
+    char *names[2] = { host, mapFile };
+    for (int n = 0; n < 2; n++) {
+        for (char *c = names[n]; *c; c++) {
+            if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20) *c = '_';
+        }
+    }
+
+    size_t length = 0;
+    int written = snprintf(out, size,
+        "{\"mapa\":\"%s\",\"maquina\":\"%s\",\"inicio\":%lld,\"resultado\":\"%s\",\"duracao_s\":%.2f,"
+        "\"pontos\":%d,\"vidas_perdidas\":%d,\"monstros_mortos\":%d,\"carga_mapa_ms\":%.3f,\"mapa_em_cache\":%s,"
+        "\"escala_render\":%d,\"frames\":%d,\"histograma_ms\":{\"limites\":[8,12,17,20,25,33,50],\"contagens\":[",
+        mapFile, host, (long long)level->startedAt, level->completed ? "vitoria" : "saida", level->duration,
+        level->score - level->startScore, level->livesLost, level->monstersKilled, level->loadTime * 1000.0,
+        level->loadTime > 0 ? "false" : "true", gameRenderScale, level->frames);
+    for (int i = 0; i < TELEMETRY_BUCKETS && written > 0 && (length += (size_t)written) < size; i++) {
+        written = snprintf(out + length, size - length, "%s%d", i ? "," : "", level->buckets[i]);
+    }
+    if (written > 0 && (length += (size_t)written) < size) {
+        written = snprintf(out + length, size - length, "]},\"piores_frames\":[");
+    }
+    for (int i = 0; i < TELEMETRY_WORST_FRAMES && level->worst[i].ms > 0 && written > 0 && (length += (size_t)written) < size; i++) {
+        written = snprintf(out + length, size - length, "%s{\"tick\":%d,\"ms\":%.2f}", i ? "," : "", level->worst[i].tick, level->worst[i].ms);
+    }
+    if (written > 0 && (length += (size_t)written) < size) {
+        written = snprintf(out + length, size - length, "]}\n");
+    }
+    if (written <= 0 || (length += (size_t)written) >= size) return 0;
+    return (int)length;
+}
+
+// Só formata e copia para o lote; o disco fica com a thread
+void SubmitLevelTelemetry(TelemetryWriter *writer, const LevelTelemetry *level) {
+    if (!writer->enabled || !level->active || level->frames == 0) return;
+
+    char record[TELEMETRY_RECORD_SIZE];
+    int length = FormatLevelTelemetry(record, sizeof(record), level);
+    if (length == 0) return;
+
+    pthread_mutex_lock(&writer->lock);
+    TelemetryBatch *batch = &writer->batches[writer->fillIndex];
+    if (batch->length + (size_t)length > TELEMETRY_BUFFER_SIZE) {
+        fprintf(stderr, "Telemetria: lote cheio, registro descartado.\n");
+    } else {
+        memcpy(batch->text + batch->length, record, (size_t)length);
+        batch->length += (size_t)length;
+        batch->records++;
+        if (batch->records >= TELEMETRY_BATCH && writer->jobIndex < 0) {
+            writer->jobIndex = writer->fillIndex;
+            writer->fillIndex = 1 - writer->fillIndex;
+            pthread_cond_signal(&writer->wake);
         }
     }
+    pthread_mutex_unlock(&writer->lock);
 }
 
-void DrawMonsterDeaths(MonsterDeathManager *deaths) {
-    for (int i = 0; i < deaths->count;) {
-        if (--deaths->deaths[i].frameCounter <= 0) {
-            for (int j = i; j < deaths->count - 1; j++) deaths->deaths[j] = deaths->deaths[j + 1];
-            deaths->count--;
+void *TelemetryWorker(void *arg) {
+    TelemetryWriter *writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+    while (true) {
+        // Ao sair, o lote que ainda estava enchendo também é gravado
+        if (writer->quit && writer->jobIndex < 0 && writer->batches[writer->fillIndex].records > 0) {
+            writer->jobIndex = writer->fillIndex;
+            writer->fillIndex = 1 - writer->fillIndex;
+        }
+        if (writer->jobIndex < 0) {
+            if (writer->quit) break;
+            pthread_cond_wait(&writer->wake, &writer->lock);
+            continue;
+        }
+
+        TelemetryBatch *batch = &writer->batches[writer->jobIndex];
+        pthread_mutex_unlock(&writer->lock);
+
+        FILE *file = fopen(TELEMETRY_FILE, "a");
+        if (file) {
+            fwrite(batch->text, 1, batch->length, file);
+            fclose(file);
         } else {
-            Rectangle deathTile = {deaths->deaths[i].col * TILE_SIZE, deaths->deaths[i].row * TILE_SIZE + HUD_HEIGHT, TILE_SIZE, TILE_SIZE};
-            float alpha = deaths->deaths[i].frameCounter / (float)MONSTER_DEATH_DURATION;
-            DrawRectangleRec(deathTile, Fade(RED, alpha));
-            i++;
+            fprintf(stderr, "Erro ao gravar a telemetria em %s\n", TELEMETRY_FILE);
         }
+
+        pthread_mutex_lock(&writer->lock);
+        batch->length = 0;
+        batch->records = 0;
+        writer->jobIndex = -1;
     }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
 }
 
-void PerformSwordAttack(char map[ROWS][COLS], Player *player, AttackEffect *effect,
-                        MonsterDeathManager *deathManager, MonsterManager *monsterManager) {
-    if (!player->swordActive) return;
+void InitFlightRecorder(FlightRecorder *recorder, float budgetMs) {
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->budgetMs = budgetMs;
+    recorder->lastDump = -HITCH_COOLDOWN;
+    CreateGameDirectory(HITCH_DIRECTORY);
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->wake, NULL);
+    pthread_create(&recorder->thread, NULL, FlightRecorderWorker, recorder);
+    recorder->started = true;
+}
 
-    bool hitMonster = false;
-    int idx = 0;
+void ShutdownFlightRecorder(FlightRecorder *recorder) {
+    if (!recorder->started) return;
+    pthread_mutex_lock(&recorder->lock);
+    recorder->quit = true;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->thread, NULL);
+
+    pthread_cond_destroy(&recorder->wake);
+    pthread_mutex_destroy(&recorder->lock);
+    recorder->started = false;
+}
 
-    for (int i = 1; i <= 3; i++) {
-        int tr = player->row + i * player->facingRow;
-        int tc = player->col + i * player->facingCol;
-        if (tr >= 0 && tr < ROWS && tc >= 0 && tc < COLS) {
-            if (map[tr][tc] == 'M') {
-                hitMonster = true;
-                if (deathManager->count < MAX_DEATH_ANIMATIONS) {
-                    deathManager->deaths[deathManager->count].row = tr;
-                    deathManager->deaths[deathManager->count].col = tc;
-                    deathManager->deaths[deathManager->count].frameCounter = MONSTER_DEATH_DURATION;
-                    deathManager->count++;
-                }
-                map[tr][tc] = ' ';
-                RemoveMonsterAt(monsterManager, tr, tc);
-                player->score += MONSTER_SCORE;
-            }
-            effect->tiles[idx++] = (Vector2){tc, tr};
+// Fecha o frame anterior (o tempo total só é conhecido agora), verifica o
+// orçamento e abre o próximo. Em frames que podiam dormir no present, só o
+// trabalho do laço conta: esperar entrada não é hitch
+void BeginFlightFrame(FlightRecorder *recorder, const App *app) {
+    double now = GetTime();
+    FrameRecord *current = &recorder->current;
+
+    if (current->start > 0) {
+        current->totalMs = (float)((now - current->start) * 1000.0);
+        recorder->frames[recorder->frameNext] = *current;
+        recorder->frameNext = (recorder->frameNext + 1) % FLIGHT_FRAMES;
+        if (recorder->frameCount < FLIGHT_FRAMES) recorder->frameCount++;
+
+        float measured = current->totalMs;
+        if (current->idle) measured -= current->phaseMs[PHASE_PRESENT];
+        if (recorder->budgetMs > 0 && measured > recorder->budgetMs && now - recorder->lastDump >= HITCH_COOLDOWN) {
+            TriggerHitchDump(recorder, app);
         }
     }
 
-    if (hitMonster) {
-        effect->active = 1;
-        effect->frameCounter = ATTACK_DURATION;
+    int64_t index = current->index + 1;
+    memset(current, 0, sizeof(*current));
+    current->index = index;
+    current->start = now;
+    current->monsters = app->game.active ? (short)CountActiveMonsters(&app->game.monsterManager) : -1;
+    recorder->phaseStart = now;
+}
+
+void MarkFlightPhase(FlightRecorder *recorder, FramePhase phase) {
+    double now = GetTime();
+    recorder->current.phaseMs[phase] += (float)((now - recorder->phaseStart) * 1000.0);
+    recorder->phaseStart = now;
+}
+
+// Só da thread principal
+void RecordFlightEvent(FlightRecorder *recorder, const char *text) {
+    if (!recorder->started) return;
+    FlightEvent *event = &recorder->events[recorder->eventNext];
+    event->time = GetTime();
+    event->frame = recorder->current.index;
+    strncpy(event->text, text, FLIGHT_EVENT_LENGTH - 1);
+    event->text[FLIGHT_EVENT_LENGTH - 1] = '\0';
+    recorder->eventNext = (recorder->eventNext + 1) % FLIGHT_EVENTS;
+    if (recorder->eventCount < FLIGHT_EVENTS) recorder->eventCount++;
+}
+
+void CaptureFlightSummary(FlightSummary *summary, const App *app) {
+    memset(summary, 0, sizeof(*summary));
+    if (app->sceneCount > 0) {
+        const char *name = app->scenes[app->sceneCount - 1].name;
+        strncpy(summary->scene, name ? name : "?", sizeof(summary->scene) - 1);
     }
-                        }
+    summary->sceneCount = app->sceneCount;
+
+    const GameSession *game = &app->game;
+    summary->inLevel = game->active;
+    if (game->active) {
+        snprintf(summary->mapFile, sizeof(summary->mapFile), "%s", game->mapFile);
+        summary->tick = game->frameCount;
+        summary->monsters = CountActiveMonsters(&game->monsterManager);
+        summary->rewinding = game->rewind.rewinding;
+    }
+    summary->playerRow = app->player.row;
+    summary->playerCol = app->player.col;
+    summary->lives = app->player.lives;
+    summary->score = app->player.score;
+    summary->autosaveBusy = app->autosave.saving;
+    summary->assetsPending = AssetsPending(&app->assets);
+
+    MemStats stats[MEM_TAG_COUNT];
+    GetMemoryStats(stats);
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) summary->memoryBytes += stats[tag].bytes;
+}
 
-                        void InitializeMonsters(char map[ROWS][COLS], MonsterManager *monsterManager) {
-                            monsterManager->count = 0;
-                            for (int i = 0; i < ROWS; i++) {
-                                for (int j = 0; j < COLS; j++) {
-                                    if (map[i][j] == 'M') {
-                                        if (monsterManager->count < MAX_MONSTERS) {
-                                            monsterManager->monsters[monsterManager->count++] = (Monster){i, j, true};
-                                        } else {
-                                            printf("Aviso: Número máximo de monstros atingido.\n");
-                                        }
-                                    }
-                                }
-                            }
-                        }
+// Copia os anéis em ordem cronológica (alguns memcpy) e acorda a thread; se
+// ela ainda estiver gravando o hitch anterior, este é ignorado
+void TriggerHitchDump(FlightRecorder *recorder, const App *app) {
+    pthread_mutex_lock(&recorder->lock);
+    bool busy = recorder->busy;
+    pthread_mutex_unlock(&recorder->lock);
+    if (busy) return;
+
+    FlightDump *dump = &recorder->dump;
+    int first = (recorder->frameNext - recorder->frameCount + FLIGHT_FRAMES) % FLIGHT_FRAMES;
+    int tail = FLIGHT_FRAMES - first < recorder->frameCount ? FLIGHT_FRAMES - first : recorder->frameCount;
+    memcpy(dump->frames, &recorder->frames[first], sizeof(FrameRecord) * tail);
+    memcpy(dump->frames + tail, recorder->frames, sizeof(FrameRecord) * (recorder->frameCount - tail));
+    dump->frameCount = recorder->frameCount;
+
+    first = (recorder->eventNext - recorder->eventCount + FLIGHT_EVENTS) % FLIGHT_EVENTS;
+    tail = FLIGHT_EVENTS - first < recorder->eventCount ? FLIGHT_EVENTS - first : recorder->eventCount;
+    memcpy(dump->events, &recorder->events[first], sizeof(FlightEvent) * tail);
+    memcpy(dump->events + tail, recorder->events, sizeof(FlightEvent) * (recorder->eventCount - tail));
+    dump->eventCount = recorder->eventCount;
+
+    CaptureFlightSummary(&dump->summary, app);
+    dump->budgetMs = recorder->budgetMs;
+
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+    snprintf(dump->filename, sizeof(dump->filename), "%s/hitch_%s_f%lld.txt", HITCH_DIRECTORY, stamp,
+             (long long)recorder->current.index);
+
+    recorder->lastDump = recorder->current.start;
+    pthread_mutex_lock(&recorder->lock);
+    recorder->busy = true;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+}
 
-                        void UpdateMonsters(char map[ROWS][COLS], MonsterManager *monsterManager, Player *player) {
-                            for (int i = 0; i < monsterManager->count; i++) {
-                                Monster *m = &monsterManager->monsters[i];
-                                if (!m->active) continue;
+bool WriteFlightDump(const FlightDump *dump) {
+    static const char *phaseNames[PHASE_COUNT] = { "assets", "entrada", "update", "som", "desenho", "present" };
 
-                                int direction = GetRandomValue(0, 3);
-                                int dRow = 0, dCol = 0;
-                                if (direction == 0) dRow = -1; else if (direction == 1) dRow = 1;
-                                else if (direction == 2) dCol = -1; else if (direction == 3) dCol = 1;
+    FILE *file = fopen(dump->filename, "w");
+    if (!file) {
+        fprintf(stderr, "Erro ao gravar o relatorio de hitch %s\n", dump->filename);
+        return false;
+    }
 
-                                int newRow = m->row + dRow;
-                                int newCol = m->col + dCol;
+    const FrameRecord *hitch = &dump->frames[dump->frameCount - 1];
+    const FlightSummary *summary = &dump->summary;
+    fprintf(file, "Hitch no frame %lld: %.2f ms (orcamento %.2f ms)\n", (long long)hitch->index, hitch->totalMs, dump->budgetMs);
+    fprintf(file, "Cena: %s (%d na pilha)\n", summary->scene, summary->sceneCount);
+    if (summary->inLevel) {
+        fprintf(file, "Fase: %s tick %d, jogador (%d,%d) vidas %d pontos %d, monstros %d%s\n", summary->mapFile, summary->tick,
+                summary->playerRow, summary->playerCol, summary->lives, summary->score, summary->monsters,
+                summary->rewinding ? ", rewind ativo" : "");
+    }
+    fprintf(file, "Autosave %s, assets %s, memoria %lld KB\n\n", summary->autosaveBusy ? "gravando" : "parado",
+            summary->assetsPending ? "pendentes" : "prontos", (long long)(summary->memoryBytes >> 10));
+
+    fprintf(file, "%8s %9s %7s", "frame", "t_ms", "total");
+    for (int p = 0; p < PHASE_COUNT; p++) fprintf(file, " %7s", phaseNames[p]);
+    fprintf(file, " %8s %s\n", "monstros", "espera");
+    for (int i = 0; i < dump->frameCount; i++) {
+        const FrameRecord *frame = &dump->frames[i];
+        fprintf(file, "%8lld %9.1f %7.2f", (long long)frame->index, (frame->start - hitch->start) * 1000.0, frame->totalMs);
+        for (int p = 0; p < PHASE_COUNT; p++) fprintf(file, " %7.2f", frame->phaseMs[p]);
+        fprintf(file, " %8d %s\n", frame->monsters, frame->idle ? "sim" : "nao");
+    }
 
-                                if (newRow >= 0 && newRow < ROWS && newCol >= 0 && newCol < COLS) {
-                                    char targetCell = map[newRow][newCol];
-                                    if (targetCell == ' ') {
-                                        map[m->row][m->col] = ' ';
-                                        map[newRow][newCol] = 'M';
-                                        m->row = newRow;
-                                        m->col = newCol;
-                                    } else if (targetCell == 'J') {
-                                        if (!player->isBlinking) {
-                                            player->lives--;
-                                            player->isBlinking = true;
-                                            player->blinkFrames = 30;
-                                        }
-                                    }
-                                }
-                            }
-                        }
+    fprintf(file, "\nEventos:\n");
+    for (int i = 0; i < dump->eventCount; i++) {
+        const FlightEvent *event = &dump->events[i];
+        fprintf(file, "%9.1f ms  frame %lld  %s\n", (event->time - hitch->start) * 1000.0, (long long)event->frame, event->text);
+    }
+    fclose(file);
+    return true;
+}
 
-                        void RemoveMonsterAt(MonsterManager *manager, int row, int col) {
-                            for (int i = 0; i < manager->count;) {
-                                Monster *m = &manager->monsters[i];
-                                if (m->active && m->row == row && m->col == col) {
-                                    m->active = false;
-                                    // Remove o monstro inativo do array
-                                    for (int j = i; j < manager->count - 1; j++) {
-                                        manager->monsters[j] = manager->monsters[j + 1];
-                                    }
-                                    manager->count--;
-                                } else {
-                                    i++;
-                                }
-                            }
-                        }
+void *FlightRecorderWorker(void *arg) {
+    FlightRecorder *recorder = arg;
 
-                        PauseAction ShowPauseMenu() {
-                            bool waiting = true;
-                            PauseAction action = PAUSE_CONTINUE;
-                            int selected = 0;
-                            const char *options[] = {
-                                "Continuar",
-                                "Salvar Jogo",
-                                "Voltar ao Menu Principal",
-                                "Fechar o Jogo"
-                            };
-
-                            while (waiting && !WindowShouldClose()) {
-                                BeginDrawing();
-                                ClearBackground(Fade(DARKGRAY, 0.8f));
-
-                                DrawText("=== PAUSE MENU ===", (SCREENWIDTH - MeasureText("=== PAUSE MENU ===", 50)) / 2, 200, 50, RAYWHITE);
-
-                                for (int i = 0; i < 4; i++) {
-                                    Color color = (i == selected) ? RED : WHITE;
-                                    DrawText(options[i], (SCREENWIDTH - MeasureText(options[i], 30)) / 2, 300 + i * 50, 30, color);
-                                }
+    pthread_mutex_lock(&recorder->lock);
+    while (true) {
+        while (!recorder->busy && !recorder->quit) pthread_cond_wait(&recorder->wake, &recorder->lock);
+        if (!recorder->busy) break;
+        pthread_mutex_unlock(&recorder->lock);
 
-                                EndDrawing();
-
-                                if (IsKeyPressed(KEY_DOWN)) selected = (selected + 1) % 4;
-                                else if (IsKeyPressed(KEY_UP)) selected = (selected - 1 + 4) % 4;
-                                else if (IsKeyPressed(KEY_ENTER)) {
-                                    switch (selected) {
-                                        case 0: action = PAUSE_CONTINUE; waiting = false; break;
-                                        case 1: action = PAUSE_SAVE; waiting = false; break;
-                                        case 2: action = PAUSE_RETURN_MENU; waiting = false; break;
-                                        case 3: action = PAUSE_EXIT_GAME; waiting = false; break;
-                                    }
-                                }
-                            }
+        WriteFlightDump(&recorder->dump);
 
-                            return action;
-                        }
+        pthread_mutex_lock(&recorder->lock);
+        recorder->busy = false;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return NULL;
+}
 
-                        void SaveGameSlot(Player *player, int slot) {
-                            if (slot < 1 || slot > 5) {
-                                printf("Slot invalido. Escolha entre 1 e 5.\n");
-                                return;
-                            }
+uint64_t HashValue(uint64_t hash, int64_t value) {
+    return (hash ^ (uint64_t)value) * FNV_PRIME;
+}
 
-                            char filename[64];
-                            snprintf(filename, sizeof(filename), "saves/save_slot%d.bin", slot);
+// Chave fixa de cada item (célula e tipo, misturados à la splitmix64): a
+// camada de itens entra no checksum como o XOR das chaves dos itens ainda no
+// mapa, então coletar um item custa um XOR e não um passe pelo mapa
+uint64_t ItemHashKey(const Map *map, int item) {
+    const Item *it = &map->items[item];
+    uint64_t x = ((uint64_t)it->row * (uint64_t)map->cols + (uint64_t)it->col) << 8 | (unsigned char)it->type;
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
 
-                            FILE *file = fopen(filename, "wb");
-                            if (!file) {
-                                fprintf(stderr, "Erro ao salvar o jogo no slot %d.\n", slot);
-                                return;
-                            }
+// Recalcula a camada inteira; só na carga da fase, no load e no rewind
+uint64_t HashItemLayer(const GameSession *game) {
+    uint64_t hash = 0;
+    for (int i = 0; i < game->map->itemCount; i++) {
+        if (game->itemActive[i]) hash ^= ItemHashKey(game->map, i);
+    }
+    return hash;
+}
 
-                            fwrite(player, sizeof(Player), 1, file);
-                            fclose(file);
-
-                            // Mostra mensagem de confirmação
-                            BeginDrawing();
-                            ClearBackground(DARKGRAY);
-                            DrawText(TextFormat("Jogo salvo no slot %d!", slot),
-                                     (SCREENWIDTH - MeasureText(TextFormat("Jogo salvo no slot %d!", slot), 30)) / 2,
-                                     SCREENHEIGHT / 2, 30, GREEN);
-                            EndDrawing();
-                            WaitTime(1.0);
-                        }
+// Checksum do estado simulado: itens (já mantidos em itemHash), Player,
+// monstros, efeito de ataque, contadores e RNG. O tempo de jogo vem do
+// relógio e as animações de morte são só visuais, então ficam de fora
+uint64_t SimulationChecksum(const GameSession *game, const Player *player) {
+    uint64_t hash = FNV_OFFSET;
+    hash = HashValue(hash, game->map->rows);
+    hash = HashValue(hash, game->map->cols);
+    hash = HashValue(hash, (int64_t)game->itemHash);
+
+    hash = HashValue(hash, player->row);
+    hash = HashValue(hash, player->col);
+    hash = HashValue(hash, player->score);
+    hash = HashValue(hash, player->lives);
+    hash = HashValue(hash, player->level);
+    hash = HashValue(hash, (player->swordActive ? 1 : 0) | (player->isBlinking ? 2 : 0));
+    hash = HashValue(hash, player->blinkFrames);
+    hash = HashValue(hash, player->facingRow);
+    hash = HashValue(hash, player->facingCol);
+    hash = HashValue(hash, player->weapon);
+    hash = HashValue(hash, player->throwables);
+    hash = HashValue(hash, (int64_t)((uint64_t)(uint32_t)player->x << 32 | (uint32_t)player->y));
+
+    const MonsterManager *monsters = &game->monsterManager;
+    hash = HashValue(hash, monsters->count);
+    for (int i = 0; i < monsters->count; i++) {
+        const Monster *m = &monsters->monsters[i];
+        hash = HashValue(hash, ((int64_t)m->row << 32) ^ ((int64_t)m->col << 2) ^ (m->active ? 1 : 0) ^ (m->ranged ? 2 : 0));
+        hash = HashValue(hash, m->cooldown);
+        hash = HashValue(hash, (int64_t)((uint64_t)(uint32_t)m->x << 32 | (uint32_t)m->y));
+        hash = HashValue(hash, (int64_t)((uint64_t)(uint16_t)m->vx << 48 | (uint64_t)(uint16_t)m->vy << 32 | (uint32_t)m->steps));
+    }
+
+    const ProjectilePool *shots = &game->projectiles;
+    hash = HashValue(hash, shots->count);
+    for (int i = 0; i < shots->count; i++) {
+        hash = HashValue(hash, (int64_t)((uint64_t)(uint32_t)shots->x[i] << 32 | (uint32_t)shots->y[i]));
+        hash = HashValue(hash, (int64_t)((uint64_t)(uint16_t)shots->vx[i] << 48 | (uint64_t)(uint16_t)shots->vy[i] << 32 |
+                                         (uint64_t)shots->life[i] << 8 | shots->owner[i]));
+    }
+
+    const AttackEffect *effect = &game->attackEffect;
+    hash = HashValue(hash, effect->active);
+    hash = HashValue(hash, effect->frameCounter);
+    hash = HashValue(hash, effect->kind);
+    hash = HashValue(hash, ((int64_t)effect->row << 32) ^ ((int64_t)effect->col << 2) ^ effect->facing);
+
+    hash = HashValue(hash, game->frameCount);
+    hash = HashValue(hash, game->ai.cursor);
+    hash = HashValue(hash, game->ai.backlog);
+    return HashValue(hash, game->rng.state);
+}
+
+bool OpenSimRecorder(SimRecorder *recorder, const char *logFile, const char *recordFile) {
+    *recorder = (SimRecorder){0};
+    if (logFile) {
+        recorder->log = fopen(logFile, "w");
+        if (!recorder->log) fprintf(stderr, "Erro ao criar o log de checksums %s.\n", logFile);
+    }
+    if (recordFile) {
+        recorder->file = fopen(recordFile, "wb");
+        if (!recorder->file) fprintf(stderr, "Erro ao criar a gravacao %s.\n", recordFile);
+        else fwrite(SIM_RECORD_MAGIC, 1, 4, recorder->file);
+        WriteVarU(&recorder->out, SIM_RECORD_VERSION);
+    }
+    return (!logFile || recorder->log) && (!recordFile || recorder->file);
+}
+
+void CloseSimRecorder(SimRecorder *recorder) {
+    FlushSimRecorder(recorder);
+    if (recorder->log) fclose(recorder->log);
+    if (recorder->file) fclose(recorder->file);
+    FreeByteWriter(&recorder->out);
+    FreeByteWriter(&recorder->delta);
+    if (recorder->stateCapacity) TrackMemory(MEM_SAVES, -2 * (int64_t)recorder->stateCapacity, -2);
+    free(recorder->previous);
+    free(recorder->current);
+    *recorder = (SimRecorder){0};
+}
+
+void FlushSimRecorder(SimRecorder *recorder) {
+    if (recorder->file && recorder->out.size > 0) {
+        fwrite(recorder->out.data, 1, recorder->out.size, recorder->file);
+    }
+    recorder->out.size = 0;
+}
+
+// O próximo tick gravado precisa de um novo estado completo
+void BreakSimRecording(SimRecorder *recorder) {
+    recorder->synced = false;
+}
+
+// Os dois buffers de estado só crescem, com a maior fase jogada
+bool ReserveSimStates(SimRecorder *recorder, size_t stateSize) {
+    if (stateSize <= recorder->stateCapacity) return true;
+    unsigned char *previous = realloc(recorder->previous, stateSize);
+    if (previous) recorder->previous = previous;
+    unsigned char *current = previous ? realloc(recorder->current, stateSize) : NULL;
+    if (current) recorder->current = current;
+    if (!previous || !current) {
+        fprintf(stderr, "Sem memoria para a gravacao da simulacao.\n");
+        return false;
+    }
+    TrackMemory(MEM_SAVES, 2 * (int64_t)(stateSize - recorder->stateCapacity), recorder->stateCapacity ? 0 : 2);
+    recorder->stateCapacity = stateSize;
+    return true;
+}
+
+// Antes do tick: se a gravação perdeu a continuidade, abre um trecho novo
+// com o estado completo da fase
+void BeginSimTick(SimRecorder *recorder, const GameSession *game, const Player *player) {
+    if (!recorder->file || recorder->synced) return;
+    size_t stateSize = RewindStateSize(game->map);
+    if (!ReserveSimStates(recorder, stateSize)) return;
+
+    recorder->delta.size = 0;
+    EncodeGameState(&recorder->delta, game, player);
+    WriteVarU(&recorder->out, SIM_RECORD_SNAPSHOT);
+    WriteVarU(&recorder->out, recorder->delta.size);
+    WriteBytes(&recorder->out, recorder->delta.data, recorder->delta.size);
+    CaptureRewindState(game, player, recorder->previous);
+    recorder->synced = true;
+}
+
+void RecordSimTick(SimRecorder *recorder, const GameSession *game, const Player *player, const InputAction *actions, int actionCount, int aiLimit, uint64_t checksum) {
+    if (recorder->log) fprintf(recorder->log, "%s %d %016llx\n", game->mapFile, game->frameCount, (unsigned long long)checksum);
+    if (!recorder->file || !recorder->synced) return;
+
+    size_t stateSize = RewindStateSize(game->map);
+    CaptureRewindState(game, player, recorder->current);
+    recorder->delta.size = 0;
+    EncodeXorRle(&recorder->delta, recorder->previous, recorder->current, stateSize);
+
+    WriteVarU(&recorder->out, SIM_RECORD_TICK);
+    WriteVarU(&recorder->out, actionCount);
+    for (int i = 0; i < actionCount; i++) WriteVarU(&recorder->out, actions[i]);
+    WriteVarU(&recorder->out, aiLimit);
+    WriteVarU(&recorder->out, checksum);
+    WriteVarU(&recorder->out, recorder->delta.size);
+    WriteBytes(&recorder->out, recorder->delta.data, recorder->delta.size);
+
+    unsigned char *swap = recorder->previous;
+    recorder->previous = recorder->current;
+    recorder->current = swap;
+    // Em blocos grandes: o stdio só chega ao disco a cada poucos segundos de jogo
+    if (recorder->out.size >= SIM_RECORD_FLUSH) FlushSimRecorder(recorder);
+}
+
+// Refaz a gravação tick a tick, sem janela, e compara os checksums. Na
+// primeira divergência mostra o que mudou entre o estado gravado e o refeito
+bool VerifyRecording(const char *filename) {
+    int size = 0;
+    unsigned char *data = LoadFileData(filename, &size);
+    if (!data || size < 4 || memcmp(data, SIM_RECORD_MAGIC, 4) != 0) {
+        fprintf(stderr, "Gravacao %s ausente ou invalida.\n", filename);
+        if (data) UnloadFileData(data);
+        return false;
+    }
+
+    ByteReader r = { data, (size_t)size, 4, false };
+    if (ReadVarU(&r) != SIM_RECORD_VERSION) {
+        fprintf(stderr, "Versao de gravacao desconhecida em %s.\n", filename);
+        UnloadFileData(data);
+        return false;
+    }
+
+    static GameSession game;
+    static SoundSystem sounds;
+    Player player = {0};
+    unsigned char *expected = NULL, *actual = NULL;
+    size_t stateSize = 0;
+    int segments = 0;
+    int64_t ticks = 0;
+    bool same = true;
+
+    while (same && r.pos < r.size && !r.error) {
+        uint64_t type = ReadVarU(&r);
+        if (type == SIM_RECORD_SNAPSHOT) {
+            size_t length = ReadVarU(&r);
+            if (r.error || length > r.size - r.pos || !DecodeGameState(r.data + r.pos, length, &game, &player)) {
+                r.error = true;
+                break;
+            }
+            r.pos += length;
+            segments++;
+
+            stateSize = RewindStateSize(game.map);
+            free(expected);
+            free(actual);
+            expected = malloc(stateSize);
+            actual = malloc(stateSize);
+            if (!expected || !actual) {
+                fprintf(stderr, "Sem memoria para verificar a gravacao.\n");
+                same = false;
+                break;
+            }
+            CaptureRewindState(&game, &player, expected);
+        } else if (type == SIM_RECORD_TICK && segments > 0) {
+            InputAction actions[MAX_INPUT_EVENTS];
+            uint64_t actionCount = ReadVarU(&r);
+            if (actionCount > MAX_INPUT_EVENTS) r.error = true;
+            for (uint64_t i = 0; i < actionCount && !r.error; i++) actions[i] = (InputAction)ReadVarU(&r);
+            uint64_t aiLimit = ReadVarU(&r);
+            uint64_t checksum = ReadVarU(&r);
+            size_t deltaSize = ReadVarU(&r);
+            if (r.error || deltaSize > r.size - r.pos) {
+                r.error = true;
+                break;
+            }
+
+            sounds.eventCount = 0;
+            ResetArena(&game.frameArena);
+            StepSimulation(&game, &player, actions, (int)actionCount, (int)(aiLimit > INT_MAX ? INT_MAX : aiLimit), &sounds);
+            ApplyXorRle(expected, r.data + r.pos, deltaSize);
+            r.pos += deltaSize;
+            ticks++;
+
+            uint64_t replayed = SimulationChecksum(&game, &player);
+            if (replayed != checksum) {
+                printf("Divergencia no trecho %d (%s), tick %d: gravado %016llx, refeito %016llx\n",
+                       segments, game.mapFile, game.frameCount, (unsigned long long)checksum, (unsigned long long)replayed);
+                CaptureRewindState(&game, &player, actual);
+                PrintStateDiff(expected, actual, game.map);
+                same = false;
+            }
+        } else {
+            r.error = true;
+        }
+    }
+
+    if (r.error) {
+        fprintf(stderr, "Gravacao %s corrompida apos %lld ticks.\n", filename, (long long)ticks);
+        same = false;
+    } else if (same) {
+        printf("%lld ticks em %d trechos verificados sem divergencia.\n", (long long)ticks, segments);
+    }
+
+    free(expected);
+    free(actual);
+    UnloadLevel(&game);
+    FreeLevelMemory(&game);
+    FreeMapCache();
+    UnloadFileData(data);
+    return same;
+}
+
+// Diff campo a campo de dois estados no layout do rewind
+void PrintStateDiff(const unsigned char *expected, const unsigned char *actual, const Map *map) {
+    size_t itemCount = (size_t)map->itemCount;
+    int itemDiffs = 0;
+    for (size_t i = 0; i < itemCount; i++) {
+        if (expected[i] == actual[i]) continue;
+        if (itemDiffs++ < SIM_DIFF_ITEMS) {
+            printf("  item %zu: gravado %s, refeito %s\n", i, expected[i] ? "no mapa" : "coletado", actual[i] ? "no mapa" : "coletado");
+        }
+    }
+    if (itemDiffs > SIM_DIFF_ITEMS) printf("  ... mais %d itens\n", itemDiffs - SIM_DIFF_ITEMS);
+
+    Player a, b;
+    memcpy(&a, expected + itemCount, sizeof(Player));
+    memcpy(&b, actual + itemCount, sizeof(Player));
+    PrintFieldDiff("jogador.linha", a.row, b.row);
+    PrintFieldDiff("jogador.coluna", a.col, b.col);
+    PrintFieldDiff("jogador.pontos", a.score, b.score);
+    PrintFieldDiff("jogador.vidas", a.lives, b.lives);
+    PrintFieldDiff("jogador.fase", a.level, b.level);
+    PrintFieldDiff("jogador.espada", a.swordActive, b.swordActive);
+    PrintFieldDiff("jogador.piscando", a.isBlinking, b.isBlinking);
+    PrintFieldDiff("jogador.framesPiscando", a.blinkFrames, b.blinkFrames);
+    PrintFieldDiff("jogador.direcaoLinha", a.facingRow, b.facingRow);
+    PrintFieldDiff("jogador.direcaoColuna", a.facingCol, b.facingCol);
+    PrintFieldDiff("jogador.arma", a.weapon, b.weapon);
+    PrintFieldDiff("jogador.facas", a.throwables, b.throwables);
+    PrintFieldDiff("jogador.x", a.x, b.x);
+    PrintFieldDiff("jogador.y", a.y, b.y);
+
+    int32_t countA, countB;
+    size_t offset = itemCount + sizeof(Player);
+    memcpy(&countA, expected + offset, sizeof(countA));
+    memcpy(&countB, actual + offset, sizeof(countB));
+    PrintFieldDiff("monstros", countA, countB);
+    offset += sizeof(int32_t);
+    int monsters = countA > countB ? countA : countB;
+    int monsterDiffs = 0;
+    for (int i = 0; i < monsters && i < map->monsterCount; i++) {
+        Monster x, y;
+        memcpy(&x, expected + offset + sizeof(Monster) * i, sizeof(Monster));
+        memcpy(&y, actual + offset + sizeof(Monster) * i, sizeof(Monster));
+        if (x.row == y.row && x.col == y.col && x.active == y.active && x.cooldown == y.cooldown &&
+            x.x == y.x && x.y == y.y && x.steps == y.steps) continue;
+        if (monsterDiffs++ < SIM_DIFF_ITEMS) {
+            printf("  monstro %d: gravado (%d,%d) corpo (%d,%d)%s recarga %d, refeito (%d,%d) corpo (%d,%d)%s recarga %d\n", i,
+                   x.row, x.col, x.x, x.y, x.active ? "" : " inativo", x.cooldown,
+                   y.row, y.col, y.x, y.y, y.active ? "" : " inativo", y.cooldown);
+        }
+    }
+    if (monsterDiffs > SIM_DIFF_ITEMS) printf("  ... mais %d monstros\n", monsterDiffs - SIM_DIFF_ITEMS);
+
+    AttackEffect ea, eb;
+    offset += sizeof(Monster) * map->monsterCount;
+    memcpy(&ea, expected + offset, sizeof(AttackEffect));
+    memcpy(&eb, actual + offset, sizeof(AttackEffect));
+    PrintFieldDiff("ataque.ativo", ea.active, eb.active);
+    PrintFieldDiff("ataque.frames", ea.frameCounter, eb.frameCounter);
+    PrintFieldDiff("ataque.arma", ea.kind, eb.kind);
+    PrintFieldDiff("ataque.linha", ea.row, eb.row);
+    PrintFieldDiff("ataque.coluna", ea.col, eb.col);
+    PrintFieldDiff("ataque.direcao", ea.facing, eb.facing);
+
+    uint32_t ca[4], cb[4];
+    offset += sizeof(AttackEffect);
+    memcpy(ca, expected + offset, sizeof(ca));
+    memcpy(cb, actual + offset, sizeof(cb));
+    PrintFieldDiff("tick", ca[0], cb[0]);
+    PrintFieldDiff("ia.cursor", ca[1], cb[1]);
+    PrintFieldDiff("ia.acumulo", ca[2], cb[2]);
+    PrintFieldDiff("rng", ca[3], cb[3]);
+
+    int32_t sa, sb;
+    offset += sizeof(ca);
+    memcpy(&sa, expected + offset, sizeof(sa));
+    memcpy(&sb, actual + offset, sizeof(sb));
+    PrintFieldDiff("projeteis", sa, sb);
+    // No estado o bloco vem depois do Player, dos monstros, do efeito e dos
+    // contadores, num deslocamento que depende do número de itens e não tem
+    // alinhamento: os vetores só são lidos depois de copiados para o malloc
+    size_t shotBytes = ProjectileArraysBytes(PROJECTILE_CAPACITY);
+    unsigned char *shotsA = malloc(shotBytes), *shotsB = malloc(shotBytes);
+    if (!shotsA || !shotsB) {
+        free(shotsA);
+        free(shotsB);
+        return;
+    }
+    memcpy(shotsA, expected + offset + sizeof(sa), shotBytes);
+    memcpy(shotsB, actual + offset + sizeof(sb), shotBytes);
+    ProjectilePool pa, pb;
+    BindProjectileArrays(&pa, shotsA, PROJECTILE_CAPACITY);
+    BindProjectileArrays(&pb, shotsB, PROJECTILE_CAPACITY);
+    int shotDiffs = 0;
+    for (int i = 0; i < sa && i < sb; i++) {
+        if (pa.x[i] == pb.x[i] && pa.y[i] == pb.y[i] && pa.life[i] == pb.life[i]) continue;
+        if (shotDiffs++ < SIM_DIFF_ITEMS) {
+            printf("  projetil %d: gravado (%d,%d) vida %d, refeito (%d,%d) vida %d\n", i,
+                   pa.x[i], pa.y[i], pa.life[i], pb.x[i], pb.y[i], pb.life[i]);
+        }
+    }
+    if (shotDiffs > SIM_DIFF_ITEMS) printf("  ... mais %d projeteis\n", shotDiffs - SIM_DIFF_ITEMS);
+    free(shotsA);
+    free(shotsB);
+}
+
+void PrintFieldDiff(const char *name, int64_t expected, int64_t actual) {
+    if (expected != actual) printf("  %s: gravado %lld, refeito %lld\n", name, (long long)expected, (long long)actual);
+}